@@ -0,0 +1,100 @@
+/*  Part of SWI-Prolog
+
+    Author:        Jan Wielemaker
+    E-mail:        J.Wielemaker@vu.nl
+    WWW:           http://www.swi-prolog.org
+    Copyright (c)  2026, SWI-Prolog Solutions b.v.
+    All rights reserved.
+
+    Redistribution and use in source and binary forms, with or without
+    modification, are permitted provided that the following conditions
+    are met:
+
+    1. Redistributions of source code must retain the above copyright
+       notice, this list of conditions and the following disclaimer.
+
+    2. Redistributions in binary form must reproduce the above copyright
+       notice, this list of conditions and the following disclaimer in
+       the documentation and/or other materials provided with the
+       distribution.
+
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+    "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+    LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+    FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+    COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+    INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+    BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+    LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+    CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+    LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+    ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+    POSSIBILITY OF SUCH DAMAGE.
+*/
+
+:- module(bench_stem_list,
+          [ bench_stem_list/0,
+            bench_stem_list/1           % +Count
+          ]).
+:- use_module(library(porter_stem)).
+:- use_module(library(snowball)).
+:- use_module(library(double_metaphone)).
+:- autoload(library(apply), [maplist/3, maplist/4]).
+:- autoload(library(lists), [numlist/3]).
+
+/** <module> Benchmark the list versions of the stemmers
+
+Compare porter_stem_list/2, snowball_list/3 and double_metaphone_list/3
+against calling porter_stem/2, snowball/3 and double_metaphone/3 through
+maplist/3,4.  The input is a list of Count short words.  Each word is a
+distinct atom such that the porter_stem/2 cache is not effective.  Run
+using
+
+    swipl bench_stem_list.pl -g bench_stem_list -t halt
+
+No timings have been recorded for this benchmark yet.
+*/
+
+bench_stem_list :-
+    bench_stem_list(1 000 000).
+
+bench_stem_list(Count) :-
+    words(Count, Words),
+    porter_stem_cache_clear,
+    bench(porter_stem,
+          maplist(porter_stem, Words, _),
+          porter_stem_list(Words, _)),
+    bench(snowball,
+          maplist(snowball(english), Words, _),
+          snowball_list(english, Words, _)),
+    bench(double_metaphone,
+          maplist(double_metaphone, Words, _, _),
+          double_metaphone_list(Words, _, _)).
+
+words(Count, Words) :-
+    numlist(1, Count, Nums),
+    maplist(word, Nums, Words).
+
+word(N, Word) :-
+    Suffix is N mod 4,
+    suffix(Suffix, S),
+    format(atom(Word), 'w~36r~w', [N, S]).
+
+suffix(0, s).
+suffix(1, ing).
+suffix(2, ed).
+suffix(3, '').
+
+bench(Name, MapList, List) :-
+    garbage_collect,
+    time_goal(MapList, T0),
+    garbage_collect,
+    time_goal(List, T1),
+    format("~w~t~20|maplist: ~3f sec, list: ~3f sec (~2fx)~n",
+           [Name, T0, T1, T0/max(T1,1.0e-6)]).
+
+time_goal(Goal, Time) :-
+    statistics(cputime, T0),
+    call(Goal),
+    statistics(cputime, T1),
+    Time is T1-T0.
@@ -228,16 +228,25 @@ MetaphAdd(metastring * s, char *new_str)
 }
 
 
-#ifdef __SWI_PROLOG__
-static
-#endif
-void
-DoubleMetaphone(char *str, char **codes)
+static void
+ResetMetaString(metastring * s, char *init_str)
+{
+    s->length = 0;
+    s->str[0] = '\0';
+    MetaphAdd(s, init_str);
+}
+
+
+/* Compute the codes for str into primary and secondary, using original
+   as scratch buffer.  The buffers are reset first, so they can be
+   reused for the next word.
+*/
+
+static void
+DoubleMetaphoneInto(char *str, metastring * original,
+		    metastring * primary, metastring * secondary)
 {
     int        length;
-    metastring *original;
-    metastring *primary;
-    metastring *secondary;
     int        current;
     int        last;
 
@@ -245,14 +254,12 @@ DoubleMetaphone(char *str, char **codes)
     /* we need the real length and last prior to padding */
     length  = (int)strlen(str);
     last    = length - 1;
-    original = NewMetaString(str);
+    ResetMetaString(original, str);
     /* Pad original so we can index beyond end */
     MetaphAdd(original, "     ");
 
-    primary = NewMetaString("");
-    secondary = NewMetaString("");
-    primary->free_string_on_destroy = 0;
-    secondary->free_string_on_destroy = 0;
+    ResetMetaString(primary, "");
+    ResetMetaString(secondary, "");
 
     MakeUpper(original);
 
@@ -1230,6 +1237,27 @@ DoubleMetaphone(char *str, char **codes)
 	SetAt(secondary, 4, '\0');
 #endif
 
+}
+
+
+#ifdef __SWI_PROLOG__
+static
+#endif
+void
+DoubleMetaphone(char *str, char **codes)
+{
+    metastring *original;
+    metastring *primary;
+    metastring *secondary;
+
+    original = NewMetaString("");
+    primary = NewMetaString("");
+    secondary = NewMetaString("");
+    primary->free_string_on_destroy = 0;
+    secondary->free_string_on_destroy = 0;
+
+    DoubleMetaphoneInto(str, original, primary, secondary);
+
     *codes = primary->str;
     *++codes = secondary->str;
 
@@ -1244,8 +1272,10 @@ DoubleMetaphone(char *str, char **codes)
 		 *	SWI-Prolog binding	*
 		 *******************************/
 
-static foreign_t
-double_metaphone3(term_t from, term_t prim, term_t sec)
+#include "text_type.ic"
+
+static int
+double_metaphone(term_t from, term_t prim, term_t sec, int type)
 { char *str;
   int rc = FALSE;
 
@@ -1254,8 +1284,8 @@ double_metaphone3(term_t from, term_t prim, term_t sec)
 
     DoubleMetaphone(str, result);
 
-    if ( PL_unify_chars(prim, PL_ATOM|REP_ISO_LATIN_1, -1, result[0]) &&
-	 (!sec || PL_unify_chars(sec,  PL_ATOM|REP_ISO_LATIN_1, -1, result[1])) )
+    if ( PL_unify_chars(prim, type|REP_ISO_LATIN_1, -1, result[0]) &&
+	 (!sec || PL_unify_chars(sec,  type|REP_ISO_LATIN_1, -1, result[1])) )
       rc = TRUE;
 
     META_FREE(result[0]);
@@ -1268,13 +1298,73 @@ double_metaphone3(term_t from, term_t prim, term_t sec)
 
 static foreign_t
 double_metaphone2(term_t from, term_t prim)
-{ return double_metaphone3(from, prim, 0);
+{ return double_metaphone(from, prim, 0, PL_ATOM);
+}
+
+
+static foreign_t
+double_metaphone3(term_t from, term_t prim, term_t sec)
+{ return double_metaphone(from, prim, sec, PL_ATOM);
+}
+
+
+static foreign_t
+double_metaphone4(term_t from, term_t prim, term_t sec, term_t options)
+{ int type;
+
+  return ( get_text_type(options, &type) &&
+	   double_metaphone(from, prim, sec, type) );
+}
+
+/* double_metaphone_list(+Words, -Primaries, -Secondaries) processes all
+   elements of Words in a single call, reusing the term references and
+   the metastring buffers for all words.
+*/
+
+static foreign_t
+double_metaphone_list(term_t words, term_t prims, term_t secs)
+{ term_t tail = PL_copy_term_ref(words);
+  term_t head = PL_new_term_ref();
+  term_t ptail = PL_copy_term_ref(prims);
+  term_t phead = PL_new_term_ref();
+  term_t stail = PL_copy_term_ref(secs);
+  term_t shead = PL_new_term_ref();
+  metastring *original  = NewMetaString("");
+  metastring *primary   = NewMetaString("");
+  metastring *secondary = NewMetaString("");
+  int rc = TRUE;
+
+  while( rc && PL_get_list_ex(tail, head, tail) )
+  { char *str;
+
+    if ( (rc=PL_get_chars(head, &str,
+			  CVT_ATOM|CVT_STRING|CVT_LIST|CVT_EXCEPTION)) )
+    { DoubleMetaphoneInto(str, original, primary, secondary);
+      rc = ( PL_unify_list(ptail, phead, ptail) &&
+	     PL_unify_list(stail, shead, stail) &&
+	     PL_unify_chars(phead, PL_ATOM|REP_ISO_LATIN_1, -1,
+			    primary->str) &&
+	     PL_unify_chars(shead, PL_ATOM|REP_ISO_LATIN_1, -1,
+			    secondary->str) );
+    }
+  }
+
+  DestroyMetaString(original);
+  DestroyMetaString(primary);
+  DestroyMetaString(secondary);
+
+  return ( rc && PL_get_nil_ex(tail) &&
+	   PL_unify_nil(ptail) && PL_unify_nil(stail) );
 }
 
 install_t
 install_double_metaphone()
-{ PL_register_foreign("double_metaphone", 2, double_metaphone2, 0);
+{ init_text_type();
+
+  PL_register_foreign("double_metaphone", 2, double_metaphone2, 0);
   PL_register_foreign("double_metaphone", 3, double_metaphone3, 0);
+  PL_register_foreign("double_metaphone", 4, double_metaphone4, 0);
+  PL_register_foreign("double_metaphone_list", 3, double_metaphone_list, 0);
 }
 
 #endif /*__SWI_PROLOG__*/
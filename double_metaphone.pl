@@ -34,7 +34,9 @@
 
 :- module(double_metaphone,
           [ double_metaphone/2,         % +In, -Primary
-            double_metaphone/3          % +In, -Primary, -Secondary
+            double_metaphone/3,         % +In, -Primary, -Secondary
+            double_metaphone/4,         % +In, -Primary, -Secondary, +Options
+            double_metaphone_list/3     % +Words, -Primaries, -Secondaries
           ]).
 
 :- use_foreign_library(foreign(double_metaphone)).
@@ -78,9 +80,23 @@ therefore including this module poses no additional license conditions.
 %   metaphone is based on english, while   the  secondary deals with
 %   common alternative pronounciation in  other   languages.  In  is
 %   either and atom, string object,  code-   or  character list. The
-%   metaphones are always returned as atoms.
+%   metaphones are returned as atoms.
+
+%!  double_metaphone(+In, -MetaPhone, -AltMetaphone, +Options) is det.
+%
+%   As double_metaphone/3, using Options to  control the result type.
+%   The only option is type(Type), where Type   is one of `atom`
+%   (default), `string`, `codes` or `chars`.  Using strings avoids
+%   creating atoms when processing large amounts of text.
+
+%!  double_metaphone_list(+Words, -MetaPhones, -AltMetaphones) is det.
+%
+%   As maplist(double_metaphone, Words, MetaPhones, AltMetaphones),
+%   but processing all elements of Words in a single call.
 
 :- multifile sandbox:safe_primitive/1.
 
 sandbox:safe_primitive(double_metaphone:double_metaphone(_,_)).
 sandbox:safe_primitive(double_metaphone:double_metaphone(_,_,_)).
+sandbox:safe_primitive(double_metaphone:double_metaphone(_,_,_,_)).
+sandbox:safe_primitive(double_metaphone:double_metaphone_list(_,_,_)).
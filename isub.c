@@ -51,177 +51,359 @@ Comparing "E56.Language" <-> "languange" (0.711348), 1,000,000 times:
 #include <stdlib.h>
 #include <wchar.h>
 #include <wctype.h>
+#include <math.h>
 #include "isub.h"
 #include "wcsdup.ic"
 
 #define MIN(a,b) ((a) < (b) ? (a) : (b))
 #define MAX(a,b) ((a) > (b) ? (a) : (b))
 
+#ifndef TRUE
+#define TRUE 1
+#define FALSE 0
+#endif
+
 #define DEBUG(g) (void)(0)
 
-// Default is [-1,1] range, and skip normalization
-#define ZERO_TO_ONE       (0x1)       // Result in [0,1] range, [-1,1] if not set
-#define NORMALIZE         (0x2)       // Normalize input words
+// Without ISUB_SCAN or ISUB_AUTOMATON, use the suffix automaton for a
+// round if both (remaining) strings have at least this length.  See
+// isub_bench() below.
+#define AUTOMATON_MIN_LENGTH 64
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+Finding the substring to remove
+
+Each round of isub_score_inplace() removes the  longest common substring
+found by the scan below from both strings. Note that the scan is greedy:
+after a match at s2[p..p+n), the search for s1[i] continues at s2[p+n],
+so it does not always find the true longest common substring. Both
+engines must reproduce this exactly.
+
+The plain engine is the original i/j/k scan.  Each round is O(l1*l2) and
+there are up to min(l1,l2)/3 rounds.  The automaton engine computes, for
+each i, ms[i]: the length of the longest prefix of s1[i..] that appears
+anywhere in s2 (the "matching statistics").  This is an upper bound for
+what the scan can find in row i, so the scan is only run for rows where
+ms[i] > best and each row stops as soon as it reaches ms[i].  If the
+first row with the highest bound reaches it, that row is the answer. The
+statistics are computed in linear time using the suffix automaton of the
+reversed s2, which is rebuilt after each round in the buffers allocated
+for the first.  In practice this scans only a handful of rows per round.
+- - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+typedef struct substring
+{ int startS1;
+  int endS1;
+  int startS2;
+  int endS2;
+} substring;
+
+/* Work done by the substring search, counted as character comparisons
+   in the rows scanned plus the length of the texts for building the
+   automaton.  The budget is checked before each row, so the search may
+   exceed max by the length of s2.
+*/
+
+typedef struct work_budget
+{ size_t used;
+  size_t max;				/* (size_t)-1: no limit */
+  int	 exhausted;			/* search stopped at max */
+} work_budget;
+
+typedef struct sam_state
+{ int len;			// length of the longest string in the class
+  int link;			// suffix link
+  int edges;			// first outgoing edge
+} sam_state;
+
+typedef struct sam_edge
+{ wint_t c;
+  int from;
+  int to;
+  int next;			// next edge from the same state
+} sam_edge;
+
+typedef struct sam
+{ sam_state *states;
+  sam_edge  *edges;
+  int	    *hash;		// (state,c) -> edge
+  int	    *ms;		// matching statistics for s1
+  int	     nstates;
+  int	     nedges;
+  unsigned   hash_mask;
+} sam;
+
+
+static int
+sam_init(sam *a, int l1, int l2)
+{ unsigned hsize = 16;
+
+  while ( hsize < 2*(3*(unsigned)l2+4) )
+    hsize *= 2;
+  a->hash_mask = hsize-1;
+
+  a->states = malloc((2*l2+1)*sizeof(*a->states));
+  a->edges  = malloc((3*l2+4)*sizeof(*a->edges));
+  a->hash   = malloc(hsize*sizeof(*a->hash));
+  a->ms     = malloc((l1+1)*sizeof(*a->ms));
+
+  if ( a->states && a->edges && a->hash && a->ms )
+    return TRUE;
+
+  free(a->states);
+  free(a->edges);
+  free(a->hash);
+  free(a->ms);
+
+  return FALSE;
+}
+
 
 static void
-toLowerCase(wchar_t *s)
-{ wchar_t *q;
+sam_destroy(sam *a)
+{ free(a->states);
+  free(a->edges);
+  free(a->hash);
+  free(a->ms);
+}
 
-  for(q=s; *q; q++)
-  { wint_t c = *q;
 
-    if ( iswupper(c) )
-    { *q = towlower(c);
-    }
-  }
+#define SAM_HASH(a, from, c) \
+	((((unsigned)(from)*0x9e3779b1u) ^ (unsigned)(c)) & (a)->hash_mask)
+
+
+static int
+sam_new_state(sam *a, int len, int link)
+{ sam_state *s = &a->states[a->nstates];
+
+  s->len   = len;
+  s->link  = link;
+  s->edges = -1;
+
+  return a->nstates++;
 }
 
 
 static void
-normalizeString(wchar_t *s, wint_t remo)
-{ wchar_t *q, *o;
+sam_add_edge(sam *a, int from, wint_t c, int to)
+{ sam_edge *e = &a->edges[a->nedges];
+  unsigned h = SAM_HASH(a, from, c);
+
+  e->c    = c;
+  e->to   = to;
+  e->from = from;
+  e->next = a->states[from].edges;
+  a->states[from].edges = a->nedges;
+
+  while ( a->hash[h] >= 0 )
+    h = (h+1) & a->hash_mask;
+  a->hash[h] = a->nedges++;
+}
 
-  for(o=q=s; *q; q++)
-  { if ( *q != remo )
-      *o++ = *q;
+
+static sam_edge *
+sam_edge_for(sam *a, int from, wint_t c)
+{ unsigned h = SAM_HASH(a, from, c);
+  int e;
+
+  for(; (e=a->hash[h]) >= 0; h = (h+1) & a->hash_mask)
+  { if ( a->edges[e].c == c && a->edges[e].from == from )
+      return &a->edges[e];
   }
 
-  *o = 0;
+  return NULL;
 }
 
 
-static size_t
-common_prefix_length(const wchar_t *s1, const wchar_t *s2)
-{ size_t i;
-  size_t n = MIN(wcslen(s1), wcslen(s2));
+/* Compute the final score from the total length of the common
+   substrings, the initial string lengths and the common prefix.  The
+   score increases with common: the commonality increases, the Hamacher
+   product of the unmatched fractions decreases and the Winkler bonus
+   is at most 0.4*(1-commonality).  Using the maximum for common thus
+   gives an upper bound for the final score.
+*/
 
-  for (i = 0; i < n; i++)
-  { if (s1[i] != s2[i])
-      break;
-  }
+static double
+isub_result(double common, int L1, int L2, size_t common_prefix_len,
+	    int options)
+{ double scaledCommon = (double) (2.0 * common) / (double)(L1 + L2);
+  double commonality = scaledCommon;
+  double dissimilarity = 0.0;
+  double rest1 = (double)L1 - common;
+  double rest2 = (double)L2 - common;
+  double unmatchedS1 = rest1 / (double)L1;
+  double unmatchedS2 = rest2 / (double)L2;
+  double result;
 
-  return i;
+		/**
+		 * Hamacher Product
+		 */
+  double suma = unmatchedS1 + unmatchedS2;
+  double product = unmatchedS1 * unmatchedS2;
+  double p = 0.6;		//For 1 it coincides with the algebraic product
+
+  double winklerImprovementVal =
+	    (double)MIN(4,common_prefix_len)*0.1*(1.0-commonality);
+
+  if ((suma - product) == 0)
+    dissimilarity = 0;
+  else
+    dissimilarity = (product) / (p + (1 - p) * (suma - product));
+
+  // Modification JE: returned normalization (instead of [-1 1])
+  result = commonality - dissimilarity + winklerImprovementVal;
+
+  if ( options & ZERO_TO_ONE )
+     return (result + 1) / 2;
+  else
+     return result;  // Original algorithm returns result in [-1,1]
 }
 
 
+/* Score for a given total length of the common substrings.  Using
+   MIN(L1,L2) for common gives an upper bound, which is used to filter
+   candidates in the index.
+*/
+
 double
-isub_score_inplace(wchar_t *s1, wchar_t *s2, int options, int substring_threshold)
-{ int l1, l2, L1, L2;
-  double common = 0.0;
-  size_t common_prefix_len;
-  int best = 2;
-
-  if ( options & NORMALIZE )
-  { toLowerCase(s1);
-    toLowerCase(s2);
-
-    normalizeString(s1, '.');
-    normalizeString(s2, '.');
-    normalizeString(s1, '_');
-    normalizeString(s2, '_');
-    normalizeString(s1, ' ');
-    normalizeString(s2, ' ');
-  }
+isub_score_common(int common, int L1, int L2, size_t common_prefix_len,
+		  int options)
+{ return isub_result(common, L1, L2, common_prefix_len, options);
+}
 
-  common_prefix_len = common_prefix_length(s1, s2);
-  l1 = (int)wcslen(s1);	// length of s
-  l2 = (int)wcslen(s2);	// length of t
-  L1 = l1;
-  L2 = l2;
-  if ((L1 == 0) && (L2 == 0))
-    return 1.0;
 
-    // Modification JE: giorgos put -1 instead of 0
-  if ((L1 == 0) || (L2 == 0))
-    return 0;
+		 /*******************************
+		 *	   NORMALIZATION	*
+		 *******************************/
 
-  while ( l1 > 0 && l2 > 0 && best != 0)
-  { int i = 0;			// iterates through s1
-    int j = 0;			// iterates through s2
-    int startS2 = 0;
-    int endS2 = 0;
-    int startS1 = 0;
-    int endS1 = 0;
-    int p = 0;
-
-    best = 0;			// the best subs length so far
-
-    for (i = 0; (i < l1) && (l1 - i > best); i++)
-    { j = 0;
-
-      while (l2 - j > best)
-      { int k = i;
-
-	for (; (j < l2) && (s1[k] != s2[j]); j++)
-	  ;
-	if (j != l2)
-	{			// we have found a starting point
-	  p = j;
-	  for ( j++, k++;
-		(j < l2) && (k < l1) && (s1[k] == s2[j]);
-		j++, k++ );
-	  if (k - i > best)
-	  { best = k - i;
-	    startS1 = i;
-	    endS1 = k;
-	    startS2 = p;
-	    endS2 = j;
-	  }
-	}
-      }
-    }
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+Normalization maps the text to  its   Unicode  simple case folding and
+removes the characters in a  removal  set,   by  default  ".",  "_" and
+" ". The folding is done using the two-level table from casefold.ic, so
+the result does not depend on the locale.  Characters are tested against
+the removal set after folding.   Characters  whose folding does not fit
+the character type are left unchanged,  i.e., MICRO SIGN remains itself
+in ISO Latin-1 text.
+- - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
 
-    DEBUG(wprintf(L"%ls(%d) %d..%d; %ls(%d) %d..%d -->",
-		  s1, l1, startS1, endS1,
-		  s2, l2, startS2, endS2));
+#include "casefold.ic"
 
-    memmove(&s1[startS1], &s1[endS1], (l1+1-endS1)*sizeof(wchar_t));
-    memmove(&s2[startS2], &s2[endS2], (l2+1-endS2)*sizeof(wchar_t));
-    l1 -= endS1-startS1;
-    l2 -= endS2-startS2;
+static inline wint_t
+casefold(wint_t c)
+{ if ( c < 0x110000 )
+    return c + casefold_delta[casefold_index[c>>8]][c&0xff];
 
-    if (best > substring_threshold)   // Original algorighm used best > 2
-       common += best;
-    else
-       best = 0;
+  return c;
+}
 
-  }
+wint_t
+isub_casefold(wint_t c)
+{ return casefold(c);
+}
 
-  { double scaledCommon = (double) (2.0 * common) / (double)(L1 + L2);
-    double commonality = scaledCommon;
-    double dissimilarity = 0.0;
-    double rest1 = (double)L1 - common;
-    double rest2 = (double)L2 - common;
-    double unmatchedS1 = rest1 / (double)L1;
-    double unmatchedS2 = rest2 / (double)L2;
-    double result;
+const isub_charset isub_default_remove =
+{ { 0,0,0,0,0x01,0x40,0,0,0,0,0,0x80 },	/* ' ', '.', '_' */
+  0,
+  NULL
+};
 
-		/**
-		 * Hamacher Product
-		 */
-    double suma = unmatchedS1 + unmatchedS2;
-    double product = unmatchedS1 * unmatchedS2;
-    double p = 0.6;		//For 1 it coincides with the algebraic product
+static inline int
+isub_charset_member(const isub_charset *set, wint_t c)
+{ size_t i;
 
-    double winklerImprovementVal =
-	      (double)MIN(4,common_prefix_len)*0.1*(1.0-commonality);
+  if ( c <= 0xff )
+    return (set->latin1[c>>3] & (1<<(c&7))) != 0;
 
-    if ((suma - product) == 0)
-      dissimilarity = 0;
-    else
-      dissimilarity = (product) / (p + (1 - p) * (suma - product));
+  for(i=0; i<set->count; i++)
+  { if ( (wint_t)set->wide[i] == c )
+      return TRUE;
+  }
 
-    // Modification JE: returned normalization (instead of [-1 1])
-    result = commonality - dissimilarity + winklerImprovementVal;
+  return FALSE;
+}
+
+int
+isub_charset_init(isub_charset *set, const wchar_t *chars, size_t len)
+{ size_t i;
+
+  memset(set, 0, sizeof(*set));
+  for(i=0; i<len; i++)
+  { wint_t c = chars[i];
 
-    if ( options & ZERO_TO_ONE )
-       return (result + 1) / 2;
-    else
-       return result;  // Original algorithm returns result in [-1,1]
+    if ( c <= 0xff )
+    { set->latin1[c>>3] |= (unsigned char)(1<<(c&7));
+    } else if ( !isub_charset_member(set, c) )
+    { wchar_t *new = realloc(set->wide, (set->count+1)*sizeof(wchar_t));
 
+      if ( !new )
+      { isub_charset_destroy(set);
+	return FALSE;
+      }
+      set->wide = new;
+      set->wide[set->count++] = (wchar_t)c;
+    }
   }
+
+  return TRUE;
+}
+
+void
+isub_charset_destroy(isub_charset *set)
+{ free(set->wide);
+  set->wide = NULL;
+  set->count = 0;
+}
+
+
+		 /*******************************
+		 *	 CHARACTER TYPES	*
+		 *******************************/
+
+#define CHAR char
+#define CODE(c) ((wint_t)(unsigned char)(c))
+#define FITS(c) ((c) <= 0xff)
+#define STRLEN(s) strlen(s)
+#define FN(name) name ## A
+#define ISUB_SCORE_INPLACE isub_score_inplaceA
+#define ISUB_SCORE_NORMALIZED isub_score_normalizedA
+#define ISUB_SCORE_PARAMS isub_score_paramsA
+#define ISUB_NORMALIZE isub_normalizeA
+#define ISUB_NORMALIZE_SET isub_normalize_setA
+#include "isub.ic"
+
+#define CHAR wchar_t
+#define CODE(c) ((wint_t)(c))
+#define FITS(c) TRUE
+#define STRLEN(s) wcslen(s)
+#define FN(name) name ## W
+#define ISUB_SCORE_INPLACE isub_score_inplace
+#define ISUB_SCORE_NORMALIZED isub_score_normalized
+#define ISUB_SCORE_PARAMS isub_score_params
+#define ISUB_NORMALIZE isub_normalize
+#define ISUB_NORMALIZE_SET isub_normalize_set
+#include "isub.ic"
+
+/* Sequences of token ids, terminated by 0.  See isub_tokens.c
+*/
+
+static size_t
+idslen(const int *s)
+{ const int *e;
+
+  for(e=s; *e; e++)
+    ;
+
+  return e-s;
 }
 
+#define CHAR int
+#define CODE(c) ((wint_t)(c))
+#define FITS(c) TRUE
+#define STRLEN(s) idslen(s)
+#define FN(name) name ## T
+#define ISUB_SCORE_NORMALIZED isub_score_tokens
+#include "isub.ic"
+
 
 double
 isub_score(const wchar_t *st1, const wchar_t *st2, int options, int substring_threshold)
@@ -238,6 +420,108 @@ isub_score(const wchar_t *st1, const wchar_t *st2, int options, int substring_th
 
 
 #ifdef STAND_ALONE
+#include <time.h>
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+isub_bench() compares the  two  engines  on   pairs  of  label-like
+strings of increasing length, where the second is a copy of the first
+with some words swapped and some characters changed.  Run as
+
+    gcc -O2 -DSTAND_ALONE -o isub isub.c && ./isub -bench
+
+Intel Xeon, gcc 12.2 -O2 (usec per comparison, NORMALIZE, threshold 2,
+median of three runs; the runs differ by up to 20%)
+
+    length       scan  automaton       auto
+         8       0.24       0.57       0.22
+        16       0.96       1.90       1.11
+        24       2.62       3.70       2.65
+        32       4.61       5.08       4.61
+        48       9.48       8.63       8.59
+        64      20.06      16.51      18.52
+       128      94.00      48.31      57.09
+       256     472.63     123.95     154.15
+       512    3031.25     528.16     504.06
+
+At 48 characters the difference between the engines is within the noise;
+from 64 characters on the automaton wins.  This is used to set
+AUTOMATON_MIN_LENGTH.  As each round removes a common substring, auto
+switches to the scan for the last rounds of long strings.
+- - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+#define BENCH_PAIRS 250
+
+static void
+random_label(wchar_t *s, int len)
+{ int i, w = 0;
+
+  for(i=0; i<len; i++)
+  { if ( w > 2 && rand()%6 == 0 )
+    { s[i] = ' ';
+      w = 0;
+    } else
+    { s[i] = 'a' + rand()%26;
+      w++;
+    }
+  }
+  s[len] = 0;
+}
+
+static void
+mutate_label(wchar_t *s, int len)
+{ int i;
+
+  for(i=0; i<len/8+1; i++)
+    s[rand()%len] = 'a' + rand()%26;
+  if ( len > 8 )			/* swap two halves */
+  { wchar_t tmp[1024];
+    int h = len/3;
+
+    wcscpy(tmp, &s[h]);
+    wcscpy(&tmp[len-h], s);
+    tmp[len] = 0;
+    wcscpy(s, tmp);
+  }
+}
+
+static double
+bench_engine(wchar_t (*pairs)[2][1024], int engine, int loops)
+{ clock_t t0 = clock();
+  int l, i;
+
+  for(l=0; l<loops; l++)
+  { for(i=0; i<BENCH_PAIRS; i++)
+      isub_score(pairs[i][0], pairs[i][1], NORMALIZE|engine, 2);
+  }
+
+  return (double)(clock()-t0)/CLOCKS_PER_SEC*1000000.0/(loops*BENCH_PAIRS);
+}
+
+static void
+isub_bench(void)
+{ static const int lengths[] = {8, 16, 24, 32, 48, 64, 128, 256, 512, 0};
+  wchar_t (*pairs)[2][1024] = malloc(BENCH_PAIRS*sizeof(*pairs));
+  const int *lp;
+
+  srand(1);
+  wprintf(L"%10ls %10ls %10ls %10ls\n", L"length", L"scan", L"automaton", L"auto");
+  for(lp=lengths; *lp; lp++)
+  { int i, loops = 8192 / *lp;
+
+    for(i=0; i<BENCH_PAIRS; i++)
+    { random_label(pairs[i][0], *lp);
+      wcscpy(pairs[i][1], pairs[i][0]);
+      mutate_label(pairs[i][1], *lp);
+    }
+
+    wprintf(L"%10d %10.2f %10.2f %10.2f\n", *lp,
+	    bench_engine(pairs, ISUB_SCAN, loops),
+	    bench_engine(pairs, ISUB_AUTOMATON, loops),
+	    bench_engine(pairs, 0, loops));
+  }
+
+  free(pairs);
+}
 
 int
 main(int argc, char **argv)
@@ -248,6 +532,11 @@ main(int argc, char **argv)
   const char *s2 = argv[2];
   size_t l1, l2;
 
+  if ( argc == 2 && strcmp(argv[1], "-bench") == 0 )
+  { isub_bench();
+    return 0;
+  }
+
   memset(&state, 0, sizeof(state));
 
   l1 = mbsrtowcs(ws1, &s1, 1024, &state);
@@ -2,8 +2,54 @@
 #define ISUB_H_INCLUDED
 
 #include <wchar.h>
+#include <math.h>
+
+// Default is [-1,1] range, and skip normalization
+#define ZERO_TO_ONE       (0x1)       // Result in [0,1] range, [-1,1] if not set
+#define NORMALIZE         (0x2)       // Normalize input words
+#define ISUB_SCAN         (0x4)       // Always use the plain scan
+#define ISUB_AUTOMATON    (0x8)       // Always use the suffix automaton
+
+typedef struct isub_work
+{ size_t used;			/* character comparisons done */
+  int	 exhausted;		/* stopped because of max_work */
+} isub_work;
+
+typedef struct isub_charset
+{ unsigned char latin1[32];	/* bitmap for 0..0xff */
+  size_t   count;		/* # characters above 0xff */
+  wchar_t *wide;		/* characters above 0xff */
+} isub_charset;
+
+typedef struct isub_params
+{ int	 options;		/* ZERO_TO_ONE, NORMALIZE, ... */
+  int	 substring_threshold;	/* only count longer substrings */
+  double min_score;		/* stop if the score cannot reach this */
+  size_t max_work;		/* stop after this much work (0: no limit) */
+  isub_work *work;		/* if not NULL, report the work done */
+  const isub_charset *remove;	/* removed by NORMALIZE (NULL: "._ ") */
+} isub_params;
+
+#define ISUB_PARAMS_INIT(options, threshold) \
+	{ options, threshold, -HUGE_VAL, 0, NULL, NULL }
+
+extern const isub_charset isub_default_remove;
+int    isub_charset_init(isub_charset *set, const wchar_t *chars, size_t len);
+void   isub_charset_destroy(isub_charset *set);
 
 double isub_score_inplace(wchar_t *s1, wchar_t *s2, int options, int substring_threshold);
+double isub_score_inplaceA(char *s1, char *s2, int options, int substring_threshold);
+double isub_score_params(wchar_t *s1, wchar_t *s2, const isub_params *p);
+double isub_score_paramsA(char *s1, char *s2, const isub_params *p);
+double isub_score_normalized(wchar_t *s1, wchar_t *s2, const isub_params *p);
+double isub_score_normalizedA(char *s1, char *s2, const isub_params *p);
+void   isub_normalize(wchar_t *s);
+void   isub_normalizeA(char *s);
+size_t isub_normalize_set(wchar_t *s, const isub_charset *remove);
+size_t isub_normalize_setA(char *s, const isub_charset *remove);
+wint_t isub_casefold(wint_t c);
+double isub_score_tokens(int *s1, int *s2, const isub_params *p);
+double isub_score_common(int common, int L1, int L2, size_t common_prefix_len, int options);
 double isub_score(const wchar_t *st1, const wchar_t *st2, int options, int substring_threshold);
 
 #endif /*ISUB_H_INCLUDED*/
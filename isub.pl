@@ -35,9 +35,30 @@
 
 :- module(isub,
           [ isub/4,              % +Text1, +Text2, -Distance, +Options
-            '$isub'/5            % +Text1, +Text2, -Distance, +Flags, +Threshold
+            isub_tokens/4,       % +Text1, +Text2, -Similarity, +Options
+            isub_prepare/3,      % +Text, +Options, -Query
+            isub_many/3,         % +Query, +Candidates, -Distances
+            isub_best/4,         % +Query, +Candidates, +K, -Ranked
+            isub_above/4,        % +Text1, +Text2, +Threshold, -Distance
+            isub_join/5,         % +ListA, +ListB, +Threshold, +Options, -Pairs
+            isub_index_create/3, % +Labels, +Options, -Index
+            isub_index_add/2,    % +Index, +Label
+            isub_index_delete/2, % +Index, +Label
+            isub_index_query/4,  % +Index, +Text, +MinSimilarity, -Matches
+            isub_index_query/5,  % +Index, +Text, +MinSimilarity, -Matches, -Stats
+            isub_index_property/2, % +Index, ?Property
+            isub_dict_create/3,  % +Labels, +Options, -Dict
+            isub_dict_query/4,   % +Dict, +Text, +MinSimilarity, -Matches
+            isub_dict_query/5,   % +Dict, +Text, +MinSimilarity, -Matches, -Stats
+            isub_dict_property/2, % +Dict, ?Property
+            '$isub'/5,           % +Text1, +Text2, -Distance, +Flags, +Threshold
+            '$isub_work'/8,      % +Text1, +Text2, -Distance, +Flags, +Threshold,
+                                 % +MaxWork, +OnError, -Work
+            '$isub_tokens'/5,    % +Text1, +Text2, -Distance, +Flags, +Threshold
+            '$isub_prepare'/5    % +Text, +Flags, +Threshold, +Remove, -Query
           ]).
 :- autoload(library(option), [option/3]).
+:- autoload(library(lists), [member/2]).
 
 :- use_foreign_library(foreign(isub)).
 
@@ -100,10 +121,10 @@ on the length of common substrings.
 %   Applies string normalization as implemented by the original
 %   authors: Text1  and Text2 are mapped
 %   to lowercase and the characters  "._   "  are removed. Lowercase
-%   mapping is done  with  the   C-library  function  towlower(). In
-%   general, the required normalization is   domain dependent and is
-%   better left to the caller.  See e.g., unaccent_atom/2. The default
-%   is to skip normalization (`false`).
+%   mapping uses Unicode simple case folding and does not depend on
+%   the locale. In general, the required normalization is domain
+%   dependent and is better left to the caller.  See e.g.,
+%   unaccent_atom/2. The default is to skip normalization (`false`).
 %
 %   - zero_to_one(+Boolean)
 %   The old isub implementation deviated from the original algorithm
@@ -120,6 +141,32 @@ on the length of common substrings.
 %   such as 0, so that the similatiry between short substrings can be
 %   properly recognized. The default value is 2 which is what the
 %   original algorithm used.
+%
+%   - engine(+Engine)
+%   Select the algorithm used to find the common substrings. `scan`
+%   is the original nested loop, which is fast for short strings but
+%   roughly cubic in the string length. `automaton` uses a suffix
+%   automaton to skip positions that cannot improve the current best
+%   match. The default, `auto`, uses the automaton if both strings
+%   have at least 64 characters.  All engines return the same result.
+%
+%   - max_work(+Count)
+%   Limit the work for finding common substrings to about Count
+%   character comparisons. The limit is checked before scanning the
+%   next position of Text1, so the actual work may exceed Count by the
+%   length of Text2. Default is `infinite`. What happens if the limit
+%   is reached depends on on_exhausted(Action).
+%
+%   - on_exhausted(+Action)
+%   If Action is `lower_bound` (default), Similarity is computed from
+%   the common substrings found so far. As the similarity increases
+%   with the length of the common substrings, this is a lower bound
+%   for the actual similarity. If Action is `error`, raise the
+%   exception resource_error(isub_work).
+%
+%   - work(-Count)
+%   Unify Count with the number of character comparisons done. This
+%   may be used to find inputs that are expensive to compare.
 
 isub(T1, T2, Normalize, Similarity) :-
    (   Normalize == true
@@ -129,15 +176,280 @@ isub(T1, T2, Normalize, Similarity) :-
    ).
 isub(T1, T2, Similarity, Options) :-
    isub_options(NumOpts,SubstringThreshold, Options),
-   '$isub'(T1,T2,Similarity,NumOpts,SubstringThreshold).
+   (   isub_work_options(MaxWork, OnError, Work, Options)
+   ->  '$isub_work'(T1,T2,Similarity,NumOpts,SubstringThreshold,
+                    MaxWork,OnError,Work)
+   ;   '$isub'(T1,T2,Similarity,NumOpts,SubstringThreshold)
+   ).
 
 isub_options(NumOpts,SubstringThreshold, Options) :-
    option(normalize(Normalize), Options, false),
    option(zero_to_one(ZeroToOne), Options, false),
    option(substring_threshold(SubstringThreshold), Options, 2),
+   option(engine(Engine), Options, auto),
    normalize_int(Normalize,NInt),
    zero_one_range_int(ZeroToOne,ZInt),
-   NumOpts is NInt \/ ZInt.
+   engine_int(Engine,EInt),
+   NumOpts is NInt \/ ZInt \/ EInt.
+
+%   isub_work_options(-MaxWork, -OnError, -Work, +Options) is semidet.
+%
+%   True if Options limit or report the work done by isub/4.
+
+isub_work_options(MaxWork, OnError, Work, Options) :-
+   (   option(max_work(_), Options)
+   ;   option(work(_), Options)
+   ),
+   !,
+   option(max_work(MaxWork), Options, infinite),
+   option(on_exhausted(OnExhausted), Options, lower_bound),
+   option(work(Work), Options, _),
+   on_exhausted_bool(OnExhausted, OnError).
+
+%!  isub_tokens(+Text1:text, +Text2:text, -Similarity:float,
+%!              +Options:list) is det.
+%
+%   As isub/4, but compares Text1 and Text2 as sequences of tokens rather
+%   than characters. The texts are split into words, numbers and
+%   punctuation characters as by tokenize_atom/2 and isub is computed
+%   over the token sequences, where two tokens match if they are equal.
+%   This is faster than isub/4 for multi-word labels and gives better
+%   results if the word order differs. E.g.
+%
+%     ```
+%     ?- isub_tokens('Department of Health and Human Services',
+%                    'Health and Human Services Department',
+%                    D, [normalize(true)]).
+%     D = 0.9090909090909091.
+%     ```
+%
+%   Options are the same as for isub/4, where normalize(true) case folds
+%   the tokens and drops punctuation tokens and substring_threshold
+%   applies to the number of tokens. As a single matching word is
+%   significant, the default substring threshold is 0.
+
+isub_tokens(T1, T2, Similarity, Options) :-
+   isub_options(NumOpts, _, Options),
+   option(substring_threshold(SubstringThreshold), Options, 0),
+   '$isub_tokens'(T1, T2, Similarity, NumOpts, SubstringThreshold).
+
+%!  isub_prepare(+Text:text, +Options:list, -Query) is det.
+%
+%   Prepare Text for comparing it against many other texts using
+%   isub_many/3.  Query is a blob that holds Text after normalization
+%   as well as the options.  Options are the same as for isub/4 and
+%   are processed at compile time if possible.  In addition, the
+%   option remove(+Chars) sets the characters that are removed by
+%   normalize(true).  Chars is a text and the default is '._ '.
+%   Characters are removed after case folding, so Chars should not
+%   contain uppercase letters.  For example:
+%
+%     ```
+%     ?- isub_prepare('E56.Language', [normalize(true)], Q),
+%        isub_many(Q, [languange, 'E56', lang], Ds).
+%     Ds = [0.4226950354609929, 0.6, 0.5333333333333333].
+%     ```
+
+isub_prepare(Text, Options, Query) :-
+   isub_options(NumOpts, SubstringThreshold, Options),
+   option(remove(Remove), Options, '._ '),
+   '$isub_prepare'(Text, NumOpts, SubstringThreshold, Remove, Query).
+
+%!  isub_many(+Query, +Candidates:list, -Similarities:list(float)) is det.
+%
+%   Compute the isub/4 similarity between  the   text  from  Query, as
+%   created by isub_prepare/3, and each of  the texts in Candidates. This
+%   is equivalent to, but much faster than,
+%
+%     ```
+%     maplist({Text,Options}/[C,D]>>isub(Text, C, D, Options),
+%             Candidates, Similarities)
+%     ```
+
+%!  isub_best(+Query, +Candidates:list, +K:nonneg, -Ranked:list) is det.
+%
+%   Ranked is a list of at most K  pairs Similarity-Candidate for the
+%   Candidates that are most similar to Query, ordered by descending
+%   similarity.  If two candidates have the same similarity, the one
+%   that appears first in Candidates is preferred. Query is either a
+%   text, which is compared using the  default options of isub/4, or a
+%   query created using isub_prepare/3.
+%
+%   This is much faster than scoring all   candidates  and sorting the
+%   result because, once K candidates   have been found, candidates are
+%   skipped if an upper bound  for   their  similarity computed from the
+%   string lengths and common prefix cannot   beat the K-th best, and
+%   scoring a candidate stops as soon  as   the  remaining text cannot
+%   lift its similarity far enough.
+
+isub_best(Query, Candidates, K, Ranked) :-
+   (   blob(Query, isub_query)
+   ->  Prepared = Query
+   ;   isub_prepare(Query, [], Prepared)
+   ),
+   '$isub_best'(Prepared, Candidates, K, Ranked).
+
+%!  isub_above(+Text1, +Text2, +Threshold:number, -Similarity:float)
+%!      is semidet.
+%
+%   True when the isub/4 similarity between Text1 and Text2 is at
+%   least Threshold.  Text1 is either a  text,   in  which case the
+%   default options of isub/4 are used, or   a  query created using
+%   isub_prepare/3. This is faster than   isub/4  followed by a test as
+%   it  stops  as  soon  as  it  is  clear  that  the  similarity  is
+%   below Threshold.
+
+%!  isub_join(+ListA:list, +ListB:list, +Threshold:number,
+%!            +Options:list, -Pairs:list) is det.
+%
+%   Pairs is a list of terms Similarity-(A-B) for each A in ListA and B
+%   in ListB whose isub/4 similarity  is   at  least Threshold. Pairs is
+%   ordered by the position of A in ListA  and then the position of B in
+%   ListB. This is typically used to   align  the labels of two
+%   ontologies. Both lists are normalized only  once and the pairs are
+%   scored by a pool of threads  that   each  process  blocks of the
+%   ListA×ListB matrix. Options are those of isub/4 and
+%
+%   - threads(+Count)
+%   Number of threads used to score the pairs. The default is the
+%   Prolog flag `cpu_count`.
+
+isub_join(ListA, ListB, Threshold, Options, Pairs) :-
+   isub_options(NumOpts, SubstringThreshold, Options),
+   (   option(threads(Threads), Options)
+   ->  true
+   ;   current_prolog_flag(cpu_count, Threads)
+   ->  true
+   ;   Threads = 1
+   ),
+   '$isub_join'(ListA, ListB, Threshold, NumOpts, SubstringThreshold,
+                Threads, Pairs).
+
+%!  isub_index_create(+Labels:list, +Options:list, -Index) is det.
+%
+%   Create an index for finding the  elements   of  Labels that are most
+%   similar to a given text  without   comparing  the  text against all
+%   labels. Options are the same as for isub/4. The index records, for
+%   each substring of length substring_threshold+1 (a _q-gram_), the
+%   labels in which it appears. As isub/4 only counts common substrings
+%   longer than the substring threshold,  a   label  that shares no
+%   q-gram with the query text has a similarity of at most -0.6 (0.2
+%   using zero_to_one(true)). Labels that are empty after normalization
+%   are ignored. Labels are stored as atoms. Index is reclaimed by atom
+%   garbage collection.
+%
+%   The index may be shared between threads.  Queries run concurrently,
+%   while isub_index_add/2 and isub_index_delete/2 are exclusive.
+
+isub_index_create(Labels, Options, Index) :-
+   isub_options(NumOpts, SubstringThreshold, Options),
+   '$isub_index_create'(Labels, NumOpts, SubstringThreshold, Index).
+
+%!  isub_index_add(+Index, +Label) is det.
+%!  isub_index_delete(+Index, +Label) is det.
+%
+%   Add Label to or delete Label from Index. Adding a label that is
+%   already in the index or deleting a label that is not in the index
+%   has no effect.
+
+%!  isub_index_query(+Index, +Text, +MinSimilarity:number,
+%!                   -Matches:list) is det.
+%!  isub_index_query(+Index, +Text, +MinSimilarity:number,
+%!                   -Matches:list, -Stats:list) is det.
+%
+%   Matches is a list of  pairs   Similarity-Label  for  all labels in
+%   Index whose isub/4 similarity with Text is at least MinSimilarity,
+%   ordered by descending similarity. Labels that share no q-gram with
+%   Text are not considered (see isub_index_create/3). Labels that do
+%   are skipped without scoring if an upper bound for their similarity
+%   computed from the string lengths  and   common  prefix is below
+%   MinSimilarity. Stats is a list with  the   number  of labels for
+%   each stage, which helps in choosing  the substring threshold and
+%   MinSimilarity:
+%
+%     - retrieved(Count)
+%       Labels sharing at least one q-gram with Text.
+%     - verified(Count)
+%       Labels that passed the upper bound test and were scored.
+%     - matches(Count)
+%       Length of Matches.
+
+isub_index_query(Index, Text, MinSimilarity, Matches) :-
+   isub_index_query(Index, Text, MinSimilarity, Matches, _).
+
+isub_index_query(Index, Text, MinSimilarity, Matches,
+                 [retrieved(R), verified(V), matches(M)]) :-
+   '$isub_index_query'(Index, Text, MinSimilarity, Matches,
+                       isub_index_stats(R, V, M)).
+
+%!  isub_index_property(+Index, ?Property) is nondet.
+%
+%   True when Property is a property of Index. Defined properties are
+%
+%     - size(Count)
+%       Number of labels in the index.
+%     - qgrams(Count)
+%       Number of distinct q-grams in the index.
+
+isub_index_property(Index, Property) :-
+   '$isub_index_size'(Index, Size, QGrams),
+   member(Property, [size(Size), qgrams(QGrams)]).
+
+%!  isub_dict_create(+Labels:list, +Options:list, -Dict) is det.
+%
+%   Create an immutable dictionary from Labels  for use with
+%   isub_dict_query/4. Options are the same as for isub/4. The labels
+%   are stored as a trie of their (normalized) text. Unlike
+%   isub_index_create/3, labels that are empty after normalization are
+%   kept. Dict is reclaimed by atom garbage collection and may be used
+%   concurrently by multiple threads.
+
+isub_dict_create(Labels, Options, Dict) :-
+   isub_options(NumOpts, SubstringThreshold, Options),
+   '$isub_dict_create'(Labels, NumOpts, SubstringThreshold, Dict).
+
+%!  isub_dict_query(+Dict, +Text, +MinSimilarity:number,
+%!                  -Matches:list) is det.
+%!  isub_dict_query(+Dict, +Text, +MinSimilarity:number,
+%!                  -Matches:list, -Stats:list) is det.
+%
+%   Matches is a list of  pairs   Similarity-Label  for  all labels in
+%   Dict whose isub/4 similarity with Text is at least MinSimilarity,
+%   ordered by descending similarity. Labels with the same similarity
+%   appear in the order of the list passed to isub_dict_create/3.
+%
+%   The trie is walked depth-first. The  common prefix with Text and
+%   the number of characters on the path   that  also appear in Text
+%   are computed once for each trie node   and shared by the labels
+%   below it.  Together  with  the  length  of  these  labels they
+%   provide an upper bound for the  similarity, which allows skipping
+%   subtrees that cannot reach MinSimilarity. Stats is a list
+%
+%     - visited(Count)
+%       Number of trie nodes visited.
+%     - scored(Count)
+%       Number of labels for which the similarity was computed.
+
+isub_dict_query(Dict, Text, MinSimilarity, Matches) :-
+   isub_dict_query(Dict, Text, MinSimilarity, Matches, _).
+
+isub_dict_query(Dict, Text, MinSimilarity, Matches,
+                [visited(V), scored(S)]) :-
+   '$isub_dict_query'(Dict, Text, MinSimilarity, Matches,
+                      isub_dict_stats(V, S)).
+
+%!  isub_dict_property(+Dict, ?Property) is nondet.
+%
+%   True when Property is a property of Dict. Defined properties are
+%
+%     - size(Count)
+%       Number of labels in the dictionary.
+%     - nodes(Count)
+%       Number of nodes in the trie.
+
+isub_dict_property(Dict, Property) :-
+   '$isub_dict_size'(Dict, Size, Nodes),
+   member(Property, [size(Size), nodes(Nodes)]).
 
 normalize_int(true,0x2).
 normalize_int(false,0x0).
@@ -145,6 +457,13 @@ normalize_int(false,0x0).
 zero_one_range_int(true,0x1).
 zero_one_range_int(false,0x0).
 
+on_exhausted_bool(lower_bound,false).
+on_exhausted_bool(error,true).
+
+engine_int(auto,0x0).
+engine_int(scan,0x4).
+engine_int(automaton,0x8).
+
 user:goal_expansion(isub(T1,T2,Normalize,D),
                     '$isub'(T1,T2,D,NumOpts,SubstringThreshold)) :-
    (   Normalize == true
@@ -152,11 +471,45 @@ user:goal_expansion(isub(T1,T2,Normalize,D),
    ;   Normalize == true
    ->  NumOpts = 0x1, SubstringThreshold = 2
    ).
-user:goal_expansion(isub(T1,T2,D,Options),
-                    '$isub'(T1,T2,D,NumOpts,SubstringThreshold)) :-
-   isub_options(NumOpts,SubstringThreshold, Options).
+user:goal_expansion(isub(T1,T2,D,Options), Expanded) :-
+   isub_options(NumOpts,SubstringThreshold, Options),
+   (   isub_work_options(MaxWork, OnError, Work, Options)
+   ->  Expanded = '$isub_work'(T1,T2,D,NumOpts,SubstringThreshold,
+                               MaxWork,OnError,Work)
+   ;   Expanded = '$isub'(T1,T2,D,NumOpts,SubstringThreshold)
+   ).
+user:goal_expansion(isub_prepare(T,Options,Q),
+                    '$isub_prepare'(T,NumOpts,SubstringThreshold,Remove,Q)) :-
+   is_list(Options),
+   isub_options(NumOpts,SubstringThreshold, Options),
+   option(remove(Remove), Options, '._ ').
 
 :- multifile sandbox:safe_primitive/1.
 
 sandbox:safe_primitive(isub:isub(_,_,_,_)).
 sandbox:safe_primitive(isub:'$isub'(_,_,_,_,_)).
+sandbox:safe_primitive(isub:'$isub_work'(_,_,_,_,_,_,_,_)).
+sandbox:safe_primitive(isub:isub_tokens(_,_,_,_)).
+sandbox:safe_primitive(isub:'$isub_tokens'(_,_,_,_,_)).
+sandbox:safe_primitive(isub:isub_prepare(_,_,_)).
+sandbox:safe_primitive(isub:'$isub_prepare'(_,_,_,_,_)).
+sandbox:safe_primitive(isub:isub_many(_,_,_)).
+sandbox:safe_primitive(isub:isub_best(_,_,_,_)).
+sandbox:safe_primitive(isub:'$isub_best'(_,_,_,_)).
+sandbox:safe_primitive(isub:isub_above(_,_,_,_)).
+sandbox:safe_primitive(isub:isub_index_create(_,_,_)).
+sandbox:safe_primitive(isub:'$isub_index_create'(_,_,_,_)).
+sandbox:safe_primitive(isub:isub_index_add(_,_)).
+sandbox:safe_primitive(isub:isub_index_delete(_,_)).
+sandbox:safe_primitive(isub:isub_index_query(_,_,_,_)).
+sandbox:safe_primitive(isub:isub_index_query(_,_,_,_,_)).
+sandbox:safe_primitive(isub:'$isub_index_query'(_,_,_,_,_)).
+sandbox:safe_primitive(isub:isub_index_property(_,_)).
+sandbox:safe_primitive(isub:'$isub_index_size'(_,_,_)).
+sandbox:safe_primitive(isub:isub_dict_create(_,_,_)).
+sandbox:safe_primitive(isub:'$isub_dict_create'(_,_,_,_)).
+sandbox:safe_primitive(isub:isub_dict_query(_,_,_,_)).
+sandbox:safe_primitive(isub:isub_dict_query(_,_,_,_,_)).
+sandbox:safe_primitive(isub:'$isub_dict_query'(_,_,_,_,_)).
+sandbox:safe_primitive(isub:isub_dict_property(_,_)).
+sandbox:safe_primitive(isub:'$isub_dict_size'(_,_,_)).
@@ -0,0 +1,549 @@
+/*  Part of SWI-Prolog
+
+    Author:        Jan Wielemaker
+    E-mail:        J.Wielemaker@vu.nl
+    WWW:           http://www.swi-prolog.org
+    Copyright (c)  2026, SWI-Prolog Solutions b.v.
+    All rights reserved.
+
+    Redistribution and use in source and binary forms, with or without
+    modification, are permitted provided that the following conditions
+    are met:
+
+    1. Redistributions of source code must retain the above copyright
+       notice, this list of conditions and the following disclaimer.
+
+    2. Redistributions in binary form must reproduce the above copyright
+       notice, this list of conditions and the following disclaimer in
+       the documentation and/or other materials provided with the
+       distribution.
+
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+    "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+    LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+    FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+    COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+    INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+    BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+    LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+    CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+    LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+    ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+    POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#define _CRT_SECURE_NO_WARNINGS 1
+#include <config.h>
+#include <SWI-Stream.h>
+#include <SWI-Prolog.h>
+#include <string.h>
+#include <stdlib.h>
+#include "isub.h"
+
+static functor_t FUNCTOR_minus2;
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+An isub_dict blob holds a set of labels   as a trie of their normalized
+text. Scoring a query walks the trie depth-first and maintains, for the
+path to the current node,
+
+  - the common prefix of the path and the query
+  - the number of path characters that can be matched against distinct
+    query characters (the multiset intersection), which is an upper
+    bound for the part of the common length contributed by the path.
+
+Both are computed once for each node and  shared by all labels below it.
+Each node also knows the  minimum  and   maximum  length  of the labels
+below it.  From this we compute  an   upper  bound  for the score of all
+labels in the subtree (see isub_score_common()) and skip the subtree if
+this is below the threshold. Labels that  are not skipped are scored by
+isub_score_normalized() using the threshold, so the scores are the same
+as for isub/4.
+
+The dict is immutable and may be used by multiple threads.
+- - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+typedef struct dict_entry
+{ atom_t	label;			/* label as given */
+  wchar_t      *text;			/* normalized text */
+  int		len;			/* length of text */
+  int		order;			/* position in the input */
+} dict_entry;
+
+typedef struct dict_node
+{ wchar_t	c;			/* character leading to this node */
+  int		first_child;		/* -1: none */
+  int		next_sibling;		/* -1: none */
+  int		min_len;		/* shortest label in the subtree */
+  int		max_len;		/* longest label in the subtree */
+  int		first_entry;		/* labels ending here */
+  int		nentries;
+} dict_node;
+
+typedef struct isub_dict
+{ int		options;
+  int		substring_threshold;
+  dict_entry   *entries;		/* sorted on text */
+  int		nentries;
+  dict_node    *nodes;
+  int		nnodes;
+  int		node_size;
+  int		max_len;		/* longest label */
+} isub_dict;
+
+
+static void
+free_dict(isub_dict *d)
+{ int i;
+
+  for(i=0; i<d->nentries; i++)
+  { PL_unregister_atom(d->entries[i].label);
+    free(d->entries[i].text);
+  }
+  free(d->entries);
+  free(d->nodes);
+  free(d);
+}
+
+static int
+release_isub_dict(atom_t symbol)
+{ isub_dict **dp = PL_blob_data(symbol, NULL, NULL);
+
+  free_dict(*dp);
+
+  return TRUE;
+}
+
+static int
+write_isub_dict(IOSTREAM *s, atom_t symbol, int flags)
+{ isub_dict **dp = PL_blob_data(symbol, NULL, NULL);
+
+  Sfprintf(s, "<isub_dict>(%p)", *dp);
+  return TRUE;
+}
+
+static PL_blob_t isub_dict_blob =
+{ PL_BLOB_MAGIC,
+  PL_BLOB_NOCOPY,
+  "isub_dict",
+  release_isub_dict,
+  NULL,
+  write_isub_dict
+};
+
+
+static int
+get_isub_dict(term_t t, isub_dict **dp)
+{ void *data;
+  PL_blob_t *type;
+
+  if ( PL_get_blob(t, &data, NULL, &type) && type == &isub_dict_blob )
+  { isub_dict **ref = data;
+
+    *dp = *ref;
+    return TRUE;
+  }
+
+  return PL_type_error("isub_dict", t);
+}
+
+
+		 /*******************************
+		 *	      BUILDING		*
+		 *******************************/
+
+static int
+compare_entries(const void *p1, const void *p2)
+{ const dict_entry *e1 = p1;
+  const dict_entry *e2 = p2;
+  int rc = wcscmp(e1->text, e2->text);
+
+  return rc ? rc : e1->order - e2->order;
+}
+
+
+static int
+new_node(isub_dict *d)
+{ dict_node *n;
+
+  if ( d->nnodes == d->node_size )
+  { int size = d->node_size ? d->node_size*2 : 256;
+    dict_node *new = realloc(d->nodes, size*sizeof(*new));
+
+    if ( !new )
+      return -1;
+    d->nodes = new;
+    d->node_size = size;
+  }
+  n = &d->nodes[d->nnodes];
+  memset(n, 0, sizeof(*n));
+  n->first_child = n->next_sibling = -1;
+
+  return d->nnodes++;
+}
+
+
+/* Build the node for entries[lo..hi), which share the first depth
+   characters.  As the entries are sorted, the ones that end at this
+   node come first and the others are grouped by their next character.
+*/
+
+static int
+build_node(isub_dict *d, int lo, int hi, int depth)
+{ int node = new_node(d);
+  int i = lo;
+  int prev = -1;
+  int min_len = -1;
+  int max_len = 0;
+
+  if ( node < 0 )
+    return -1;
+  while ( i < hi && d->entries[i].len == depth )
+    i++;
+  d->nodes[node].first_entry = lo;
+  d->nodes[node].nentries = i-lo;
+  if ( i > lo )
+    min_len = max_len = depth;
+
+  while ( i < hi )
+  { wchar_t c = d->entries[i].text[depth];
+    int j = i, child;
+
+    while ( j < hi && d->entries[j].text[depth] == c )
+      j++;
+    if ( (child=build_node(d, i, j, depth+1)) < 0 )
+      return -1;
+    d->nodes[child].c = c;
+    if ( prev < 0 )
+      d->nodes[node].first_child = child;
+    else
+      d->nodes[prev].next_sibling = child;
+    prev = child;
+    if ( min_len < 0 || d->nodes[child].min_len < min_len )
+      min_len = d->nodes[child].min_len;
+    if ( d->nodes[child].max_len > max_len )
+      max_len = d->nodes[child].max_len;
+    i = j;
+  }
+
+  d->nodes[node].min_len = min_len;
+  d->nodes[node].max_len = max_len;
+
+  return node;
+}
+
+
+static foreign_t
+pl_isub_dict_create(term_t labels, term_t toptions, term_t tthreshold,
+		    term_t dict)
+{ isub_dict *d;
+  term_t tail = PL_copy_term_ref(labels);
+  term_t head = PL_new_term_ref();
+  size_t len;
+
+  if ( !(d = calloc(1, sizeof(*d))) )
+    return PL_resource_error("memory");
+  if ( !PL_get_integer_ex(toptions, &d->options) ||
+       !PL_get_integer_ex(tthreshold, &d->substring_threshold) )
+    goto error;
+  if ( PL_skip_list(labels, 0, &len) != PL_LIST )
+  { PL_type_error("list", labels);
+    goto error;
+  }
+  if ( !(d->entries = calloc(len ? len : 1, sizeof(*d->entries))) )
+    goto nomem;
+
+  while( PL_get_list(tail, head, tail) )
+  { dict_entry *e = &d->entries[d->nentries];
+    wchar_t *ws;
+    size_t l;
+
+    if ( !PL_get_wchars(head, &l, &ws,
+			CVT_ATOMIC|CVT_LIST|BUF_STACK|CVT_EXCEPTION) )
+      goto error;
+    if ( !(e->label = PL_new_atom_wchars(l, ws)) )
+      goto error;
+    if ( !(e->text = malloc((l+1)*sizeof(wchar_t))) )
+    { PL_unregister_atom(e->label);
+      goto nomem;
+    }
+    memcpy(e->text, ws, l*sizeof(wchar_t));	/* ws may be the text of an atom */
+    e->text[l] = 0;
+    if ( (d->options&NORMALIZE) )
+      l = isub_normalize_set(e->text, NULL);
+    e->len = (int)l;
+    e->order = d->nentries++;
+    if ( e->len > d->max_len )
+      d->max_len = e->len;
+  }
+
+  qsort(d->entries, d->nentries, sizeof(*d->entries), compare_entries);
+  if ( d->nentries == 0 )
+  { if ( new_node(d) < 0 )
+      goto nomem;
+  } else if ( build_node(d, 0, d->nentries, 0) < 0 )
+  { goto nomem;
+  }
+
+  return PL_unify_blob(dict, &d, sizeof(d), &isub_dict_blob);
+
+nomem:
+  PL_resource_error("memory");
+error:
+  free_dict(d);
+  return FALSE;
+}
+
+
+		 /*******************************
+		 *	       WALKING		*
+		 *******************************/
+
+typedef struct dict_hit
+{ double	score;
+  int		entry;
+  int		order;			/* input order of the entry */
+} dict_hit;
+
+typedef struct dict_walk
+{ isub_dict    *dict;
+  isub_params	params;
+  const wchar_t *query;			/* normalized query */
+  int		L1;
+  wchar_t      *qchars;			/* distinct query characters */
+  int	       *available;		/* # unused per distinct char */
+  int		nqchars;
+  wchar_t      *path;			/* text of the current node */
+  wchar_t      *s1;			/* scratch for scoring */
+  wchar_t      *s2;
+  dict_hit     *hits;
+  int		nhits;
+  int		hit_size;
+  size_t	visited;		/* # nodes visited */
+  size_t	scored;			/* # labels scored */
+} dict_walk;
+
+
+static int
+qchar_index(const dict_walk *w, wchar_t c)
+{ int i;
+
+  for(i=0; i<w->nqchars; i++)
+  { if ( w->qchars[i] == c )
+      return i;
+  }
+
+  return -1;
+}
+
+
+/* True if no label below n, at depth with the given common prefix and
+   matched path characters, can reach the threshold.  The common length
+   of a label of length L2 is at most the matched characters plus the
+   L2-depth characters below n.
+*/
+
+static int
+prune_node(const dict_walk *w, const dict_node *n, int depth,
+	   size_t cp, int prefix_open, int matched)
+{ int L1 = w->L1;
+  int L2;
+  size_t cpb = prefix_open ? 4 : cp;
+
+  if ( L1 == 0 || n->min_len == 0 )
+    return FALSE;
+
+  for(L2=n->min_len; L2<=n->max_len; L2++)
+  { int common = matched + (L2-depth);
+
+    if ( common > L1 ) common = L1;
+    if ( common > L2 ) common = L2;
+    if ( isub_score_common(common, L1, L2, cpb, w->params.options) >=
+	 w->params.min_score )
+      return FALSE;
+  }
+
+  return TRUE;
+}
+
+
+static int
+score_entries(dict_walk *w, const dict_node *n)
+{ int i;
+
+  for(i=n->first_entry; i<n->first_entry+n->nentries; i++)
+  { dict_entry *e = &w->dict->entries[i];
+    double sim;
+
+    memcpy(w->s1, w->query, (w->L1+1)*sizeof(wchar_t));
+    memcpy(w->s2, e->text, (e->len+1)*sizeof(wchar_t));
+    sim = isub_score_normalized(w->s1, w->s2, &w->params);
+    w->scored++;
+    if ( sim >= w->params.min_score )
+    { if ( w->nhits == w->hit_size )
+      { int size = w->hit_size ? w->hit_size*2 : 64;
+	dict_hit *new = realloc(w->hits, size*sizeof(*new));
+
+	if ( !new )
+	  return FALSE;
+	w->hits = new;
+	w->hit_size = size;
+      }
+      w->hits[w->nhits].score = sim;
+      w->hits[w->nhits].entry = i;
+      w->hits[w->nhits].order = e->order;
+      w->nhits++;
+    }
+  }
+
+  return TRUE;
+}
+
+
+static int
+walk_node(dict_walk *w, int node, int depth, size_t cp, int prefix_open,
+	  int matched)
+{ const dict_node *n = &w->dict->nodes[node];
+  int child;
+
+  w->visited++;
+  if ( prune_node(w, n, depth, cp, prefix_open, matched) )
+    return TRUE;
+  if ( n->nentries && !score_entries(w, n) )
+    return FALSE;
+
+  for(child=n->first_child; child >= 0;
+      child=w->dict->nodes[child].next_sibling)
+  { wchar_t c = w->dict->nodes[child].c;
+    int open = prefix_open && depth < w->L1 && w->query[depth] == c;
+    int qi = qchar_index(w, c);
+    int take = qi >= 0 && w->available[qi] > 0;
+    int rc;
+
+    w->path[depth] = c;
+    if ( take )
+      w->available[qi]--;
+    rc = walk_node(w, child, depth+1, open ? (size_t)depth+1 : cp, open,
+		   matched+take);
+    if ( take )
+      w->available[qi]++;
+    if ( !rc )
+      return FALSE;
+  }
+
+  return TRUE;
+}
+
+
+static int
+compare_hits(const void *p1, const void *p2)
+{ const dict_hit *h1 = p1;
+  const dict_hit *h2 = p2;
+
+  return h1->score > h2->score ? -1 :
+	 h1->score < h2->score ?  1 :
+	 h1->order - h2->order;
+}
+
+
+static foreign_t
+pl_isub_dict_query(term_t tdict, term_t text, term_t tthreshold,
+		   term_t tmatches, term_t tstats)
+{ isub_dict *d;
+  dict_walk w;
+  wchar_t *ws, *qtext = NULL;
+  size_t len;
+  int i, rc = FALSE;
+
+  memset(&w, 0, sizeof(w));
+  if ( !get_isub_dict(tdict, &d) ||
+       !PL_get_float_ex(tthreshold, &w.params.min_score) ||
+       !PL_get_wchars(text, &len, &ws,
+		      CVT_ATOMIC|CVT_LIST|BUF_STACK|CVT_EXCEPTION) )
+    return FALSE;
+
+  w.dict = d;
+  w.params.options = d->options;
+  w.params.substring_threshold = d->substring_threshold;
+  if ( !(qtext = malloc((len+1)*sizeof(wchar_t))) )
+    goto nomem;
+  memcpy(qtext, ws, len*sizeof(wchar_t));	/* ws may be the text of an atom */
+  qtext[len] = 0;
+  if ( (d->options&NORMALIZE) )
+    len = isub_normalize_set(qtext, NULL);
+  ws = qtext;
+  w.query = ws;
+  w.L1 = (int)len;
+
+  if ( !(w.qchars = malloc((len+1)*sizeof(wchar_t))) ||
+       !(w.available = malloc((len+1)*sizeof(int))) ||
+       !(w.path = malloc((d->max_len+1)*sizeof(wchar_t))) ||
+       !(w.s1 = malloc((len+1)*sizeof(wchar_t))) ||
+       !(w.s2 = malloc((d->max_len+1)*sizeof(wchar_t))) )
+    goto nomem;
+  for(i=0; i<w.L1; i++)
+  { int qi = qchar_index(&w, ws[i]);
+
+    if ( qi < 0 )
+    { qi = w.nqchars++;
+      w.qchars[qi] = ws[i];
+      w.available[qi] = 0;
+    }
+    w.available[qi]++;
+  }
+
+  if ( !walk_node(&w, 0, 0, 0, TRUE, 0) )
+    goto nomem;
+  qsort(w.hits, w.nhits, sizeof(*w.hits), compare_hits);
+
+  { term_t tail = PL_copy_term_ref(tmatches);
+    term_t head = PL_new_term_ref();
+
+    rc = TRUE;
+    for(i=0; rc && i<w.nhits; i++)
+    { rc = ( PL_unify_list(tail, head, tail) &&
+	     PL_unify_term(head, PL_FUNCTOR, FUNCTOR_minus2,
+				   PL_FLOAT, w.hits[i].score,
+				   PL_ATOM, d->entries[w.hits[i].entry].label) );
+    }
+    rc = ( rc && PL_unify_nil(tail) &&
+	   PL_unify_term(tstats,
+			 PL_FUNCTOR_CHARS, "isub_dict_stats", 2,
+			   PL_INT64, (int64_t)w.visited,
+			   PL_INT64, (int64_t)w.scored) );
+  }
+  goto out;
+
+nomem:
+  rc = PL_resource_error("memory");
+out:
+  free(qtext);
+  free(w.qchars);
+  free(w.available);
+  free(w.path);
+  free(w.s1);
+  free(w.s2);
+  free(w.hits);
+
+  return rc;
+}
+
+
+static foreign_t
+pl_isub_dict_size(term_t tdict, term_t tsize, term_t tnodes)
+{ isub_dict *d;
+
+  return ( get_isub_dict(tdict, &d) &&
+	   PL_unify_integer(tsize, d->nentries) &&
+	   PL_unify_integer(tnodes, d->nnodes) );
+}
+
+
+void
+install_isub_dict(void)
+{ FUNCTOR_minus2 = PL_new_functor(PL_new_atom("-"), 2);
+
+  PL_register_foreign("$isub_dict_create", 4, pl_isub_dict_create, 0);
+  PL_register_foreign("$isub_dict_query", 5, pl_isub_dict_query, 0);
+  PL_register_foreign("$isub_dict_size", 3, pl_isub_dict_size, 0);
+}
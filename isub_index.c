@@ -0,0 +1,799 @@
+/*  Part of SWI-Prolog
+
+    Author:        Jan Wielemaker
+    E-mail:        J.Wielemaker@vu.nl
+    WWW:           http://www.swi-prolog.org
+    Copyright (c)  2026, SWI-Prolog Solutions b.v.
+    All rights reserved.
+
+    Redistribution and use in source and binary forms, with or without
+    modification, are permitted provided that the following conditions
+    are met:
+
+    1. Redistributions of source code must retain the above copyright
+       notice, this list of conditions and the following disclaimer.
+
+    2. Redistributions in binary form must reproduce the above copyright
+       notice, this list of conditions and the following disclaimer in
+       the documentation and/or other materials provided with the
+       distribution.
+
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+    "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+    LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+    FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+    COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+    INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+    BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+    LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+    CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+    LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+    ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+    POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#define _CRT_SECURE_NO_WARNINGS 1
+#include <config.h>
+#include <SWI-Stream.h>
+#include <SWI-Prolog.h>
+#include <pthread.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include "isub.h"
+
+static functor_t FUNCTOR_minus2;
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+An isub_index blob holds a set of labels with an inverted index on their
+q-grams, where q is substring_threshold+1.  isub   only counts common
+substrings longer than substring_threshold and the   first  round finds a
+substring that appears in both  original   strings.  So,  a  label with a
+non-zero common length shares at least  one   q-gram  with the query. A
+label that shares no q-gram has common  length   0  and  a score of at
+most -0.6 (0.2 using zero_to_one). Such labels are never returned.
+
+Note that we cannot filter on the   _number_  of shared q-grams: after a
+substring is removed the remaining parts are  joined and later rounds may
+find substrings that span the cut and   do not appear in the original
+strings.  Instead, the retrieved labels are   filtered using the upper
+bound from the lengths and common   prefix  before running the bounded
+isub_score_normalized().
+
+The index is protected by a read-write lock: queries may run concurrently
+and add/delete are exclusive.  Deleted labels leave their id in the posting
+lists until more than half of the ids are dead, after which the postings
+are rebuilt.  Empty labels are not indexed.
+- - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+typedef struct label
+{ atom_t	label;			/* label as given (0: deleted) */
+  wchar_t      *text;			/* normalized text */
+  int		len;			/* length of text */
+} label;
+
+typedef struct posting
+{ uint64_t	key;			/* hash of the q-gram */
+  int	       *ids;			/* labels holding the q-gram */
+  int		count;
+  int		size;
+} posting;
+
+typedef struct isub_index
+{ pthread_rwlock_t lock;
+  int		options;		/* isub options */
+  int		substring_threshold;
+  int		q;			/* q-gram length */
+  label	       *labels;			/* label id -> label */
+  int		nlabels;		/* allocated ids */
+  int		label_size;
+  int		deleted;		/* # deleted ids */
+  int	       *by_atom;		/* atom -> label id */
+  size_t	by_atom_mask;
+  posting      *postings;		/* q-gram -> posting */
+  size_t	npostings;
+  size_t	posting_mask;
+} isub_index;
+
+
+		 /*******************************
+		 *	       BLOB		*
+		 *******************************/
+
+static void free_index(isub_index *ix);
+
+static int
+release_isub_index(atom_t symbol)
+{ isub_index **ip = PL_blob_data(symbol, NULL, NULL);
+
+  free_index(*ip);
+
+  return TRUE;
+}
+
+static int
+write_isub_index(IOSTREAM *s, atom_t symbol, int flags)
+{ isub_index **ip = PL_blob_data(symbol, NULL, NULL);
+
+  Sfprintf(s, "<isub_index>(%p)", *ip);
+  return TRUE;
+}
+
+static PL_blob_t isub_index_blob =
+{ PL_BLOB_MAGIC,
+  PL_BLOB_NOCOPY,
+  "isub_index",
+  release_isub_index,
+  NULL,
+  write_isub_index
+};
+
+
+static int
+get_isub_index(term_t t, isub_index **ip)
+{ void *data;
+  PL_blob_t *type;
+
+  if ( PL_get_blob(t, &data, NULL, &type) && type == &isub_index_blob )
+  { isub_index **ref = data;
+
+    *ip = *ref;
+    return TRUE;
+  }
+
+  return PL_type_error("isub_index", t);
+}
+
+
+		 /*******************************
+		 *	      HASHING		*
+		 *******************************/
+
+static uint64_t
+qgram_key(const wchar_t *s, int q)
+{ uint64_t h = 0xcbf29ce484222325ULL;	/* FNV-1a */
+  int i;
+
+  for(i=0; i<q; i++)
+  { h ^= (uint64_t)s[i];
+    h *= 0x100000001b3ULL;
+  }
+
+  return h ? h : 1;			/* 0 marks an empty slot */
+}
+
+#define ATOM_HASH(a) ((size_t)((a)>>7) * 0x9e3779b97f4a7c15ULL)
+
+static int
+resize_postings(isub_index *ix)
+{ size_t size = (ix->posting_mask+1)*2;
+  posting *new = calloc(size, sizeof(*new));
+  size_t i;
+
+  if ( !new )
+    return FALSE;
+  for(i=0; i<=ix->posting_mask; i++)
+  { posting *p = &ix->postings[i];
+
+    if ( p->key )
+    { size_t h = (size_t)p->key & (size-1);
+
+      while ( new[h].key )
+	h = (h+1) & (size-1);
+      new[h] = *p;
+    }
+  }
+  free(ix->postings);
+  ix->postings = new;
+  ix->posting_mask = size-1;
+
+  return TRUE;
+}
+
+static posting *
+lookup_posting(const isub_index *ix, uint64_t key)
+{ size_t h = (size_t)key & ix->posting_mask;
+
+  for(; ix->postings[h].key; h = (h+1) & ix->posting_mask)
+  { if ( ix->postings[h].key == key )
+      return &ix->postings[h];
+  }
+
+  return NULL;
+}
+
+static posting *
+add_posting(isub_index *ix, uint64_t key)
+{ size_t h;
+
+  if ( (ix->npostings+1)*2 > ix->posting_mask+1 && !resize_postings(ix) )
+    return NULL;
+
+  for(h = (size_t)key & ix->posting_mask;
+      ix->postings[h].key;
+      h = (h+1) & ix->posting_mask)
+  { if ( ix->postings[h].key == key )
+      return &ix->postings[h];
+  }
+  ix->postings[h].key = key;
+  ix->npostings++;
+
+  return &ix->postings[h];
+}
+
+static int
+add_id(posting *p, int id)
+{ if ( p->count > 0 && p->ids[p->count-1] == id )
+    return TRUE;			/* q-gram appears twice in the label */
+  if ( p->count == p->size )
+  { int size = p->size ? p->size*2 : 4;
+    int *ids = realloc(p->ids, size*sizeof(int));
+
+    if ( !ids )
+      return FALSE;
+    p->ids = ids;
+    p->size = size;
+  }
+  p->ids[p->count++] = id;
+
+  return TRUE;
+}
+
+static int
+index_label(isub_index *ix, int id)
+{ label *l = &ix->labels[id];
+  int i;
+
+  for(i=0; i+ix->q <= l->len; i++)
+  { posting *p;
+
+    if ( !(p=add_posting(ix, qgram_key(&l->text[i], ix->q))) ||
+	 !add_id(p, id) )
+      return FALSE;
+  }
+
+  return TRUE;
+}
+
+
+/* Remove the q-grams of label id from the postings.  Only used to undo
+   index_label() for the last label, so id is at the end of the posting
+   lists.
+*/
+
+static void
+unindex_label(isub_index *ix, int id)
+{ label *l = &ix->labels[id];
+  int i;
+
+  for(i=0; i+ix->q <= l->len; i++)
+  { posting *p = lookup_posting(ix, qgram_key(&l->text[i], ix->q));
+
+    if ( p && p->count > 0 && p->ids[p->count-1] == id )
+      p->count--;
+  }
+}
+
+
+/* Label id of a or -1.  If found, *slot is its slot in by_atom */
+
+static int
+find_label_slot(const isub_index *ix, atom_t a, size_t *slot)
+{ size_t h = ATOM_HASH(a) & ix->by_atom_mask;
+  int id;
+
+  for(; (id=ix->by_atom[h]) >= 0; h = (h+1) & ix->by_atom_mask)
+  { if ( ix->labels[id].label == a )
+    { *slot = h;
+      return id;
+    }
+  }
+
+  return -1;
+}
+
+static int
+find_label(const isub_index *ix, atom_t a)
+{ size_t h;
+
+  return find_label_slot(ix, a, &h);
+}
+
+/* Delete slot h from by_atom, moving later entries of the probe sequence
+   back such that no tombstones are needed.
+*/
+
+static void
+delete_by_atom_slot(isub_index *ix, size_t h)
+{ size_t mask = ix->by_atom_mask;
+  size_t j = h;
+
+  for(;;)
+  { size_t k;
+    int id;
+
+    j = (j+1) & mask;
+    if ( (id=ix->by_atom[j]) < 0 )
+      break;
+    k = ATOM_HASH(ix->labels[id].label) & mask;
+    if ( ((j-k) & mask) >= ((j-h) & mask) )	/* k is not in (h,j] */
+    { ix->by_atom[h] = id;
+      h = j;
+    }
+  }
+  ix->by_atom[h] = -1;
+}
+
+static int
+resize_by_atom(isub_index *ix, size_t size)
+{ int *new = malloc(size*sizeof(int));
+  int id;
+
+  if ( !new )
+    return FALSE;
+  memset(new, -1, size*sizeof(int));
+  for(id=0; id<ix->nlabels; id++)
+  { if ( ix->labels[id].label )
+    { size_t h = ATOM_HASH(ix->labels[id].label) & (size-1);
+
+      while ( new[h] >= 0 )
+	h = (h+1) & (size-1);
+      new[h] = id;
+    }
+  }
+  free(ix->by_atom);
+  ix->by_atom = new;
+  ix->by_atom_mask = size-1;
+
+  return TRUE;
+}
+
+
+/* Rebuild the label table and the postings without the deleted labels
+*/
+
+static int
+compact_index(isub_index *ix)
+{ int from, to;
+  size_t i;
+
+  for(i=0; i<=ix->posting_mask; i++)
+    free(ix->postings[i].ids);
+  memset(ix->postings, 0, (ix->posting_mask+1)*sizeof(posting));
+  ix->npostings = 0;
+
+  for(from=to=0; from<ix->nlabels; from++)
+  { if ( ix->labels[from].label )
+      ix->labels[to++] = ix->labels[from];
+  }
+  ix->nlabels = to;
+  ix->deleted = 0;
+
+  for(from=0; from<ix->nlabels; from++)
+  { if ( !index_label(ix, from) )
+      return FALSE;
+  }
+
+  return resize_by_atom(ix, ix->by_atom_mask+1);
+}
+
+
+		 /*******************************
+		 *	   ADD/DELETE		*
+		 *******************************/
+
+static int
+add_label(isub_index *ix, term_t t)
+{ wchar_t *ws, *text;
+  size_t len, h;
+  atom_t a;
+  label *l;
+  int id;
+
+  if ( !PL_get_wchars(t, &len, &ws, CVT_ATOMIC|CVT_LIST|BUF_STACK|CVT_EXCEPTION) )
+    return FALSE;
+  if ( !(a = PL_new_atom_wchars(len, ws)) )
+    return FALSE;
+  if ( find_label(ix, a) >= 0 )
+  { PL_unregister_atom(a);
+    return TRUE;
+  }
+
+  if ( ix->nlabels == ix->label_size )
+  { int size = ix->label_size ? ix->label_size*2 : 64;
+    label *new = realloc(ix->labels, size*sizeof(label));
+
+    if ( !new )
+      goto nomem;
+    ix->labels = new;
+    ix->label_size = size;
+  }
+  if ( (size_t)(ix->nlabels+1)*2 > ix->by_atom_mask+1 &&
+       !resize_by_atom(ix, (ix->by_atom_mask+1)*2) )
+    goto nomem;
+
+					/* ws may be the text of an atom */
+  if ( !(text = malloc((len+1)*sizeof(wchar_t))) )
+    goto nomem;
+  memcpy(text, ws, len*sizeof(wchar_t));
+  text[len] = 0;
+  if ( (ix->options&NORMALIZE) )
+  { isub_normalize(text);
+    len = wcslen(text);
+  }
+  if ( len == 0 )
+  { free(text);
+    PL_unregister_atom(a);
+    return TRUE;
+  }
+  id = ix->nlabels;
+  l = &ix->labels[id];
+  l->text = text;
+  l->len = (int)len;
+  l->label = a;
+  ix->nlabels++;
+
+  for(h = ATOM_HASH(a) & ix->by_atom_mask;
+      ix->by_atom[h] >= 0;
+      h = (h+1) & ix->by_atom_mask)
+    ;
+  ix->by_atom[h] = id;
+
+  if ( index_label(ix, id) )
+    return TRUE;
+
+  unindex_label(ix, id);		/* roll back */
+  ix->by_atom[h] = -1;			/* h was the end of its probe sequence */
+  ix->nlabels--;
+  l->label = 0;
+  free(l->text);
+  l->text = NULL;
+
+nomem:
+  PL_unregister_atom(a);
+  return PL_resource_error("memory");
+}
+
+
+static int
+delete_label(isub_index *ix, term_t t)
+{ atom_t a;
+  wchar_t *ws;
+  size_t len;
+  size_t h;
+  int id;
+
+  if ( !PL_get_wchars(t, &len, &ws, CVT_ATOMIC|CVT_LIST|CVT_EXCEPTION) ||
+       !(a = PL_new_atom_wchars(len, ws)) )
+    return FALSE;
+  id = find_label_slot(ix, a, &h);
+  PL_unregister_atom(a);
+  if ( id < 0 )
+    return TRUE;
+
+  delete_by_atom_slot(ix, h);
+  PL_unregister_atom(ix->labels[id].label);
+  ix->labels[id].label = 0;
+  free(ix->labels[id].text);
+  ix->labels[id].text = NULL;
+  ix->deleted++;
+
+  if ( ix->deleted*2 > ix->nlabels )
+    return compact_index(ix) || PL_resource_error("memory");
+
+  return TRUE;
+}
+
+
+static void
+free_index(isub_index *ix)
+{ int id;
+  size_t i;
+
+  for(id=0; id<ix->nlabels; id++)
+  { if ( ix->labels[id].label )
+    { PL_unregister_atom(ix->labels[id].label);
+      free(ix->labels[id].text);
+    }
+  }
+  for(i=0; i<=ix->posting_mask; i++)
+    free(ix->postings[i].ids);
+  free(ix->labels);
+  free(ix->postings);
+  free(ix->by_atom);
+  pthread_rwlock_destroy(&ix->lock);
+  free(ix);
+}
+
+
+		 /*******************************
+		 *	     PREDICATES		*
+		 *******************************/
+
+static foreign_t
+pl_isub_index_create(term_t labels, term_t toptions, term_t tthreshold,
+		     term_t index)
+{ isub_index *ix;
+  term_t tail = PL_copy_term_ref(labels);
+  term_t head = PL_new_term_ref();
+  int options, threshold;
+
+  if ( !PL_get_integer_ex(toptions, &options) ||
+       !PL_get_integer_ex(tthreshold, &threshold) )
+    return FALSE;
+
+  if ( !(ix = calloc(1, sizeof(*ix))) )
+    return PL_resource_error("memory");
+  pthread_rwlock_init(&ix->lock, NULL);
+  ix->options = options;
+  ix->substring_threshold = threshold;
+  ix->q = threshold < 0 ? 1 : threshold+1;
+  ix->posting_mask = 255;
+  ix->by_atom_mask = 255;
+  if ( !(ix->postings = calloc(ix->posting_mask+1, sizeof(posting))) ||
+       !(ix->by_atom = malloc((ix->by_atom_mask+1)*sizeof(int))) )
+  { free_index(ix);
+    return PL_resource_error("memory");
+  }
+  memset(ix->by_atom, -1, (ix->by_atom_mask+1)*sizeof(int));
+
+  while( PL_get_list_ex(tail, head, tail) )
+  { if ( !add_label(ix, head) )
+    { free_index(ix);
+      return FALSE;
+    }
+  }
+  if ( !PL_get_nil_ex(tail) )
+  { free_index(ix);
+    return FALSE;
+  }
+
+  return PL_unify_blob(index, &ix, sizeof(ix), &isub_index_blob);
+}
+
+
+static foreign_t
+pl_isub_index_add(term_t index, term_t label)
+{ isub_index *ix;
+  int rc;
+
+  if ( !get_isub_index(index, &ix) )
+    return FALSE;
+  pthread_rwlock_wrlock(&ix->lock);
+  rc = add_label(ix, label);
+  pthread_rwlock_unlock(&ix->lock);
+
+  return rc;
+}
+
+
+static foreign_t
+pl_isub_index_delete(term_t index, term_t label)
+{ isub_index *ix;
+  int rc;
+
+  if ( !get_isub_index(index, &ix) )
+    return FALSE;
+  pthread_rwlock_wrlock(&ix->lock);
+  rc = delete_label(ix, label);
+  pthread_rwlock_unlock(&ix->lock);
+
+  return rc;
+}
+
+
+
+typedef struct match
+{ double	score;
+  int		id;
+} match;
+
+static int
+compare_matches(const void *p1, const void *p2)
+{ const match *m1 = p1;
+  const match *m2 = p2;
+
+  return m1->score > m2->score ? -1 :
+	 m1->score < m2->score ?  1 :
+	 m1->id < m2->id ? -1 : m1->id > m2->id ? 1 : 0;
+}
+
+
+static size_t
+common_prefix(const wchar_t *s1, int l1, const wchar_t *s2, int l2)
+{ int i, n = l1 < l2 ? l1 : l2;
+
+  for(i=0; i<n && s1[i] == s2[i]; i++)
+    ;
+
+  return i;
+}
+
+
+typedef struct query_stats
+{ size_t	retrieved;		/* labels sharing a q-gram */
+  size_t	verified;		/* labels passing the length bound */
+  size_t	matches;		/* labels above the threshold */
+} query_stats;
+
+static int
+query_index(isub_index *ix, wchar_t *qtext, int qlen, double min_score,
+	    match **matchesp, query_stats *stats)
+{ int *cands = NULL;
+  size_t total = 0, size = 16, mask, i;
+  match *matches = NULL;
+  wchar_t *s1 = NULL, *s2 = NULL;
+  int maxlen = qlen;
+  int qpos;
+  isub_params p = ISUB_PARAMS_INIT(ix->options, ix->substring_threshold);
+
+  p.min_score = min_score;
+  memset(stats, 0, sizeof(*stats));
+
+  for(qpos=0; qpos+ix->q <= qlen; qpos++)
+  { posting *pst = lookup_posting(ix, qgram_key(&qtext[qpos], ix->q));
+
+    if ( pst )
+      total += pst->count;
+  }
+  if ( total > (size_t)ix->nlabels )
+    total = ix->nlabels;
+  while ( size < total*2 )
+    size *= 2;
+  mask = size-1;
+  if ( !(cands = malloc(size*sizeof(*cands))) )
+    goto nomem;
+  memset(cands, -1, size*sizeof(*cands));		/* -1: empty */
+
+  for(qpos=0; qpos+ix->q <= qlen; qpos++)
+  { posting *pst = lookup_posting(ix, qgram_key(&qtext[qpos], ix->q));
+    int j;
+
+    if ( !pst )
+      continue;
+    for(j=0; j<pst->count; j++)
+    { int id = pst->ids[j];
+      size_t h = ((size_t)id * 0x9e3779b97f4a7c15ULL) & mask;
+
+      if ( !ix->labels[id].label )
+	continue;			/* deleted */
+      for(; cands[h] >= 0 && cands[h] != id; h = (h+1) & mask)
+	;
+      if ( cands[h] < 0 )
+      { cands[h] = id;
+	stats->retrieved++;
+	if ( ix->labels[id].len > maxlen )
+	  maxlen = ix->labels[id].len;
+      }
+    }
+  }
+
+  if ( stats->retrieved &&
+       ( !(matches = malloc(stats->retrieved*sizeof(*matches))) ||
+	 !(s1 = malloc((maxlen+1)*sizeof(wchar_t))) ||
+	 !(s2 = malloc((maxlen+1)*sizeof(wchar_t))) ) )
+    goto nomem;
+
+  for(i=0; i<size; i++)
+  { label *l;
+    double sim;
+
+    if ( cands[i] < 0 )
+      continue;
+    l = &ix->labels[cands[i]];
+    if ( isub_score_common(qlen < l->len ? qlen : l->len, qlen, l->len,
+			   common_prefix(qtext, qlen, l->text, l->len),
+			   ix->options) < min_score )
+      continue;
+
+    stats->verified++;
+    memcpy(s1, qtext, (qlen+1)*sizeof(wchar_t));
+    memcpy(s2, l->text, (l->len+1)*sizeof(wchar_t));
+    sim = isub_score_normalized(s1, s2, &p);
+    if ( sim >= min_score )
+    { matches[stats->matches].score = sim;
+      matches[stats->matches].id = cands[i];
+      stats->matches++;
+    }
+  }
+
+  free(cands);
+  free(s1);
+  free(s2);
+  if ( stats->matches )
+    qsort(matches, stats->matches, sizeof(*matches), compare_matches);
+  *matchesp = matches;
+
+  return TRUE;
+
+nomem:
+  free(cands);
+  free(matches);
+  free(s1);
+  free(s2);
+  return FALSE;
+}
+
+
+static foreign_t
+pl_isub_index_query(term_t index, term_t text, term_t tmin, term_t tmatches,
+		    term_t tstats)
+{ isub_index *ix;
+  wchar_t *ws, *qtext;
+  size_t len;
+  double min_score;
+  match *matches = NULL;
+  query_stats stats;
+  int rc;
+
+  if ( !get_isub_index(index, &ix) ||
+       !PL_get_float_ex(tmin, &min_score) ||
+       !PL_get_wchars(text, &len, &ws,
+		      CVT_ATOMIC|CVT_LIST|BUF_STACK|CVT_EXCEPTION) )
+    return FALSE;
+  if ( !(qtext = malloc((len+1)*sizeof(wchar_t))) )
+    return PL_resource_error("memory");
+  memcpy(qtext, ws, len*sizeof(wchar_t));	/* ws may be the text of an atom */
+  qtext[len] = 0;
+  if ( (ix->options&NORMALIZE) )
+  { isub_normalize(qtext);
+    len = wcslen(qtext);
+  }
+
+  pthread_rwlock_rdlock(&ix->lock);
+  rc = query_index(ix, qtext, (int)len, min_score, &matches, &stats);
+  if ( rc )
+  { term_t tail = PL_copy_term_ref(tmatches);
+    term_t head = PL_new_term_ref();
+    size_t i;
+
+    for(i=0; rc && i<stats.matches; i++)
+    { rc = ( PL_unify_list(tail, head, tail) &&
+	     PL_unify_term(head, PL_FUNCTOR, FUNCTOR_minus2,
+				   PL_FLOAT, matches[i].score,
+				   PL_ATOM, ix->labels[matches[i].id].label) );
+    }
+    rc = rc && PL_unify_nil(tail);
+  } else
+  { rc = PL_resource_error("memory");
+  }
+  pthread_rwlock_unlock(&ix->lock);
+  free(matches);
+  free(qtext);
+
+  return ( rc &&
+	   PL_unify_term(tstats,
+			 PL_FUNCTOR_CHARS, "isub_index_stats", 3,
+			   PL_INT64, (int64_t)stats.retrieved,
+			   PL_INT64, (int64_t)stats.verified,
+			   PL_INT64, (int64_t)stats.matches) );
+}
+
+
+static foreign_t
+pl_isub_index_size(term_t index, term_t tsize, term_t tqgrams)
+{ isub_index *ix;
+  int64_t size, qgrams;
+
+  if ( !get_isub_index(index, &ix) )
+    return FALSE;
+  pthread_rwlock_rdlock(&ix->lock);
+  size = ix->nlabels - ix->deleted;
+  qgrams = (int64_t)ix->npostings;
+  pthread_rwlock_unlock(&ix->lock);
+
+  return ( PL_unify_int64(tsize, size) &&
+	   PL_unify_int64(tqgrams, qgrams) );
+}
+
+
+void
+install_isub_index(void)
+{ FUNCTOR_minus2 = PL_new_functor(PL_new_atom("-"), 2);
+
+  PL_register_foreign("$isub_index_create", 4, pl_isub_index_create, 0);
+  PL_register_foreign("isub_index_add", 2, pl_isub_index_add, 0);
+  PL_register_foreign("isub_index_delete", 2, pl_isub_index_delete, 0);
+  PL_register_foreign("$isub_index_query", 5, pl_isub_index_query, 0);
+  PL_register_foreign("$isub_index_size", 3, pl_isub_index_size, 0);
+}
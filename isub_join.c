@@ -0,0 +1,367 @@
+/*  Part of SWI-Prolog
+
+    Author:        Jan Wielemaker
+    E-mail:        J.Wielemaker@vu.nl
+    WWW:           http://www.swi-prolog.org
+    Copyright (c)  2026, SWI-Prolog Solutions b.v.
+    All rights reserved.
+
+    Redistribution and use in source and binary forms, with or without
+    modification, are permitted provided that the following conditions
+    are met:
+
+    1. Redistributions of source code must retain the above copyright
+       notice, this list of conditions and the following disclaimer.
+
+    2. Redistributions in binary form must reproduce the above copyright
+       notice, this list of conditions and the following disclaimer in
+       the documentation and/or other materials provided with the
+       distribution.
+
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+    "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+    LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+    FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+    COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+    INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+    BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+    LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+    CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+    LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+    ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+    POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#define _CRT_SECURE_NO_WARNINGS 1
+#include <config.h>
+#include <SWI-Stream.h>
+#include <SWI-Prolog.h>
+#include <pthread.h>
+#include <string.h>
+#include <stdlib.h>
+#include "isub.h"
+
+static functor_t FUNCTOR_minus2;
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+isub_join/5 scores all pairs of two lists of labels.  Both lists are
+converted and normalized once, after which the A×B matrix is split into
+tiles of JOIN_TILE_A × JOIN_TILE_B pairs.   A fixed number of workers
+takes tiles from a shared counter until all   tiles are done. A tile is
+small enough for the labels of both sides  to stay in the cache. Workers
+only touch the C copies of the   labels,  so they do not need a Prolog
+engine.  Each worker collects its hits   in  a private buffer, which we
+merge and sort after all workers have finished.
+- - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+#define JOIN_TILE_A 32
+#define JOIN_TILE_B 256
+#define JOIN_MAX_THREADS 256
+
+typedef struct join_text
+{ char	       *text;			/* ISO Latin-1 text or NULL */
+  wchar_t      *wtext;			/* Wide character text */
+  int		len;
+} join_text;
+
+typedef struct join_side
+{ join_text    *texts;
+  term_t	terms;			/* the original list elements */
+  size_t	count;
+  int		maxlen;
+} join_side;
+
+typedef struct join_hit
+{ int		a;			/* index into A */
+  int		b;			/* index into B */
+  double	sim;
+} join_hit;
+
+typedef struct join_job
+{ join_side	A;
+  join_side	B;
+  isub_params	params;
+  size_t	tiles_b;		/* # tiles in a row */
+  size_t	tiles;			/* total # tiles */
+  size_t	next;			/* next tile to process */
+  pthread_mutex_t lock;
+} join_job;
+
+typedef struct join_worker
+{ join_job     *job;
+  pthread_t	thread;
+  join_hit     *hits;
+  size_t	nhits;
+  size_t	size;
+  int		nomem;
+} join_worker;
+
+
+static int
+get_side(term_t list, join_side *side, int options)
+{ term_t tail = PL_copy_term_ref(list);
+  term_t head = PL_new_term_ref();
+  size_t len, i;
+
+  if ( PL_skip_list(list, 0, &len) != PL_LIST )
+    return PL_type_error("list", list);
+  side->count = len;
+  side->maxlen = 0;
+  if ( !(side->terms = PL_new_term_refs((int)len)) ||
+       !(side->texts = calloc(len ? len : 1, sizeof(join_text))) )
+    return PL_resource_error("memory");
+
+  for(i=0; PL_get_list(tail, head, tail); i++)
+  { join_text *t = &side->texts[i];
+    wchar_t *ws;
+    size_t l, j;
+
+    if ( !PL_get_wchars(head, &l, &ws,
+			CVT_ATOMIC|CVT_LIST|BUF_STACK|CVT_EXCEPTION) )
+      return FALSE;
+    PL_put_term(side->terms+i, head);
+    if ( !(t->wtext = malloc((l+1)*sizeof(wchar_t))) )
+      return PL_resource_error("memory");
+    memcpy(t->wtext, ws, l*sizeof(wchar_t));	/* ws may be the text of an atom */
+    t->wtext[l] = 0;
+    if ( (options&NORMALIZE) )
+    { isub_normalize(t->wtext);
+      l = wcslen(t->wtext);
+    }
+    t->len = (int)l;
+    if ( t->len > side->maxlen )
+      side->maxlen = t->len;
+
+    for(j=0; j<l && t->wtext[j] <= 0xff; j++)
+      ;
+    if ( j == l && (t->text = malloc(l+1)) )
+    { for(j=0; j<=l; j++)
+	t->text[j] = (char)t->wtext[j];
+    }
+  }
+
+  return TRUE;
+}
+
+
+static void
+free_side(join_side *side)
+{ size_t i;
+
+  if ( side->texts )
+  { for(i=0; i<side->count; i++)
+    { free(side->texts[i].text);
+      free(side->texts[i].wtext);
+    }
+    free(side->texts);
+  }
+}
+
+
+static int
+add_hit(join_worker *w, int a, int b, double sim)
+{ if ( w->nhits == w->size )
+  { size_t size = w->size ? w->size*2 : 256;
+    join_hit *hits = realloc(w->hits, size*sizeof(join_hit));
+
+    if ( !hits )
+      return FALSE;
+    w->hits = hits;
+    w->size = size;
+  }
+  w->hits[w->nhits].a = a;
+  w->hits[w->nhits].b = b;
+  w->hits[w->nhits].sim = sim;
+  w->nhits++;
+
+  return TRUE;
+}
+
+
+static void *
+join_work(void *closure)
+{ join_worker *w = closure;
+  join_job *job = w->job;
+  int maxlen = job->A.maxlen > job->B.maxlen ? job->A.maxlen : job->B.maxlen;
+  wchar_t *s1 = malloc((maxlen+1)*sizeof(wchar_t));
+  wchar_t *s2 = malloc((maxlen+1)*sizeof(wchar_t));
+
+  if ( !s1 || !s2 )
+  { w->nomem = TRUE;
+    goto out;
+  }
+
+  for(;;)
+  { size_t tile, a0, a1, b0, b1, a, b;
+
+    pthread_mutex_lock(&job->lock);
+    tile = job->next++;
+    pthread_mutex_unlock(&job->lock);
+    if ( tile >= job->tiles )
+      break;
+
+    a0 = (tile/job->tiles_b)*JOIN_TILE_A;
+    b0 = (tile%job->tiles_b)*JOIN_TILE_B;
+    a1 = a0+JOIN_TILE_A < job->A.count ? a0+JOIN_TILE_A : job->A.count;
+    b1 = b0+JOIN_TILE_B < job->B.count ? b0+JOIN_TILE_B : job->B.count;
+
+    for(a=a0; a<a1; a++)
+    { join_text *ta = &job->A.texts[a];
+
+      for(b=b0; b<b1; b++)
+      { join_text *tb = &job->B.texts[b];
+	double sim;
+
+	if ( ta->text && tb->text )
+	{ memcpy(s1, ta->text, ta->len+1);
+	  memcpy(s2, tb->text, tb->len+1);
+	  sim = isub_score_normalizedA((char*)s1, (char*)s2, &job->params);
+	} else
+	{ memcpy(s1, ta->wtext, (ta->len+1)*sizeof(wchar_t));
+	  memcpy(s2, tb->wtext, (tb->len+1)*sizeof(wchar_t));
+	  sim = isub_score_normalized(s1, s2, &job->params);
+	}
+
+	if ( sim >= job->params.min_score &&
+	     !add_hit(w, (int)a, (int)b, sim) )
+	{ w->nomem = TRUE;
+	  goto out;
+	}
+      }
+    }
+  }
+
+out:
+  free(s1);
+  free(s2);
+  return NULL;
+}
+
+
+static int
+compare_hits(const void *p1, const void *p2)
+{ const join_hit *h1 = p1;
+  const join_hit *h2 = p2;
+
+  return h1->a < h2->a ? -1 : h1->a > h2->a ? 1 :
+	 h1->b < h2->b ? -1 : h1->b > h2->b ? 1 : 0;
+}
+
+
+static int
+run_join(join_job *job, int nthreads, join_hit **hitsp, size_t *counthp)
+{ join_worker *workers;
+  size_t total = 0;
+  int i, started, rc = TRUE;
+  join_hit *hits;
+
+  if ( (size_t)nthreads > job->tiles )
+    nthreads = job->tiles ? (int)job->tiles : 1;
+  if ( !(workers = calloc(nthreads, sizeof(*workers))) )
+    return FALSE;
+
+  for(i=0; i<nthreads; i++)
+    workers[i].job = job;
+  for(started=1; started<nthreads; started++)
+  { if ( pthread_create(&workers[started].thread, NULL,
+			join_work, &workers[started]) != 0 )
+      break;
+  }
+  join_work(&workers[0]);		/* the calling thread works too */
+  for(i=1; i<started; i++)
+    pthread_join(workers[i].thread, NULL);
+
+  for(i=0; i<started; i++)
+  { if ( workers[i].nomem )
+      rc = FALSE;
+    total += workers[i].nhits;
+  }
+
+  if ( rc && (hits = malloc((total ? total : 1)*sizeof(join_hit))) )
+  { size_t n = 0;
+
+    for(i=0; i<started; i++)
+    { if ( workers[i].nhits )
+	memcpy(&hits[n], workers[i].hits, workers[i].nhits*sizeof(join_hit));
+      n += workers[i].nhits;
+    }
+    qsort(hits, total, sizeof(join_hit), compare_hits);
+    *hitsp = hits;
+    *counthp = total;
+  } else
+    rc = FALSE;
+
+  for(i=0; i<started; i++)
+    free(workers[i].hits);
+  free(workers);
+
+  return rc;
+}
+
+
+static foreign_t
+pl_isub_join(term_t la, term_t lb, term_t tthreshold, term_t toptions,
+	     term_t tsubstring_threshold, term_t tthreads, term_t pairs)
+{ join_job job;
+  int nthreads;
+  join_hit *hits = NULL;
+  size_t nhits = 0;
+  int rc;
+
+  memset(&job, 0, sizeof(job));
+  job.params.min_score = -HUGE_VAL;
+  if ( !PL_get_integer_ex(toptions, &job.params.options) ||
+       !PL_get_integer_ex(tsubstring_threshold,
+			  &job.params.substring_threshold) ||
+       !PL_get_float_ex(tthreshold, &job.params.min_score) ||
+       !PL_get_integer_ex(tthreads, &nthreads) )
+    return FALSE;
+  if ( nthreads < 1 )
+    nthreads = 1;
+  else if ( nthreads > JOIN_MAX_THREADS )
+    nthreads = JOIN_MAX_THREADS;
+
+  if ( !(rc = ( get_side(la, &job.A, job.params.options) &&
+		get_side(lb, &job.B, job.params.options) )) )
+    goto out;
+
+  job.tiles_b = (job.B.count+JOIN_TILE_B-1)/JOIN_TILE_B;
+  job.tiles   = ((job.A.count+JOIN_TILE_A-1)/JOIN_TILE_A) * job.tiles_b;
+  pthread_mutex_init(&job.lock, NULL);
+  rc = run_join(&job, nthreads, &hits, &nhits);
+  pthread_mutex_destroy(&job.lock);
+
+  if ( rc )
+  { term_t tail = PL_copy_term_ref(pairs);
+    term_t head = PL_new_term_ref();
+    size_t i;
+
+    for(i=0; rc && i<nhits; i++)
+    { rc = ( PL_unify_list(tail, head, tail) &&
+	     PL_unify_term(head, PL_FUNCTOR, FUNCTOR_minus2,
+				   PL_FLOAT, hits[i].sim,
+				   PL_FUNCTOR, FUNCTOR_minus2,
+				     PL_TERM, job.A.terms+hits[i].a,
+				     PL_TERM, job.B.terms+hits[i].b) );
+    }
+    rc = rc && PL_unify_nil(tail);
+  } else
+  { rc = PL_resource_error("memory");
+  }
+
+out:
+  free(hits);
+  free_side(&job.A);
+  free_side(&job.B);
+
+  return rc;
+}
+
+
+void
+install_isub_join(void)
+{ FUNCTOR_minus2 = PL_new_functor(PL_new_atom("-"), 2);
+
+  PL_register_foreign("$isub_join", 7, pl_isub_join, 0);
+}
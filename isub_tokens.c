@@ -0,0 +1,268 @@
+/*  Part of SWI-Prolog
+
+    Author:        Jan Wielemaker
+    E-mail:        J.Wielemaker@vu.nl
+    WWW:           http://www.swi-prolog.org
+    Copyright (c)  2026, SWI-Prolog Solutions b.v.
+    All rights reserved.
+
+    Redistribution and use in source and binary forms, with or without
+    modification, are permitted provided that the following conditions
+    are met:
+
+    1. Redistributions of source code must retain the above copyright
+       notice, this list of conditions and the following disclaimer.
+
+    2. Redistributions in binary form must reproduce the above copyright
+       notice, this list of conditions and the following disclaimer in
+       the documentation and/or other materials provided with the
+       distribution.
+
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+    "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+    LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+    FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+    COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+    INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+    BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+    LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+    CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+    LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+    ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+    POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#define _CRT_SECURE_NO_WARNINGS 1
+#include <config.h>
+#include <SWI-Stream.h>
+#include <SWI-Prolog.h>
+#include <string.h>
+#include <stdlib.h>
+#include <wctype.h>
+#include "isub.h"
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+Token mode of isub: both texts are split  into words and numbers by the
+tokenizer of porter_stem.c, each distinct token is  mapped to a small
+integer and isub is run on the  resulting   id  sequences.  With
+NORMALIZE, tokens are case folded  and   punctuation  tokens are dropped.
+The ids are local to a comparison. They  start at 1, so the sequences
+can be 0-terminated like the strings of the character mode.
+- - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+#include "tokenize.ic"
+
+typedef struct token
+{ size_t	start;			/* offset in chars */
+  size_t	len;
+  unsigned int	hash;
+} token;
+
+typedef struct token_table
+{ int		options;
+  wchar_t      *chars;			/* text of the tokens */
+  size_t	nchars;
+  size_t	chars_size;
+  token	       *tokens;			/* id-1 -> token */
+  size_t	ntokens;
+  size_t	tokens_size;
+  int	       *hash;			/* open hash: id or 0 */
+  size_t	hash_mask;
+  int	       *ids;			/* output sequence */
+  size_t	nids;
+  size_t	ids_size;
+} token_table;
+
+
+static int
+grow(void **ptr, size_t *size, size_t need, size_t unit)
+{ if ( need > *size )
+  { size_t nsize = *size ? *size : 64;
+    void *new;
+
+    while ( nsize < need )
+      nsize *= 2;
+    if ( !(new = realloc(*ptr, nsize*unit)) )
+      return FALSE;
+    *ptr = new;
+    *size = nsize;
+  }
+
+  return TRUE;
+}
+
+#define GROW(tt, f, n) \
+	grow((void**)&(tt)->f, &(tt)->f ## _size, (n), sizeof(*(tt)->f))
+
+
+static int
+rehash_tokens(token_table *tt)
+{ size_t size = tt->hash_mask ? (tt->hash_mask+1)*2 : 64;
+  int *new = calloc(size, sizeof(int));
+  size_t i;
+
+  if ( !new )
+    return FALSE;
+  for(i=0; i<tt->ntokens; i++)
+  { size_t h = tt->tokens[i].hash & (size-1);
+
+    while ( new[h] )
+      h = (h+1) & (size-1);
+    new[h] = (int)i+1;
+  }
+  free(tt->hash);
+  tt->hash = new;
+  tt->hash_mask = size-1;
+
+  return TRUE;
+}
+
+
+/* Add the token at tt->chars[start..nchars) to the output sequence,
+   reusing the id of an identical token.
+*/
+
+static int
+add_token(token_table *tt, size_t start)
+{ const wchar_t *s = &tt->chars[start];
+  size_t len = tt->nchars - start;
+  unsigned int hash = 0x811c9dc5;	/* FNV-1a */
+  size_t i, h;
+  int id;
+
+  for(i=0; i<len; i++)
+  { hash ^= (unsigned int)s[i];
+    hash *= 0x01000193;
+  }
+
+  if ( (tt->ntokens+1)*2 > tt->hash_mask+1 && !rehash_tokens(tt) )
+    return FALSE;
+
+  for(h = hash & tt->hash_mask; (id=tt->hash[h]); h = (h+1) & tt->hash_mask)
+  { token *t = &tt->tokens[id-1];
+
+    if ( t->hash == hash && t->len == len &&
+	 memcmp(&tt->chars[t->start], s, len*sizeof(wchar_t)) == 0 )
+    { tt->nchars = start;		/* we already have the text */
+      break;
+    }
+  }
+
+  if ( !id )
+  { token *t;
+
+    if ( !GROW(tt, tokens, tt->ntokens+1) )
+      return FALSE;
+    t = &tt->tokens[tt->ntokens++];
+    t->start = start;
+    t->len = len;
+    t->hash = hash;
+    id = (int)tt->ntokens;
+    tt->hash[h] = id;
+  }
+
+  if ( !GROW(tt, ids, tt->nids+1) )
+    return FALSE;
+  tt->ids[tt->nids++] = id;
+
+  return TRUE;
+}
+
+
+#define ADD_TOKEN(CHAR) \
+  { token_table *tt = closure; \
+    size_t start = tt->nchars; \
+    size_t i; \
+\
+    if ( type == TOK_PUNCT && (tt->options&NORMALIZE) ) \
+      return TRUE; \
+    if ( !GROW(tt, chars, start+len) ) \
+      return PL_resource_error("memory"); \
+    for(i=0; i<len; i++) \
+    { wint_t c = (wint_t)(CHAR)s[i]; \
+\
+      tt->chars[start+i] = (wchar_t)((tt->options&NORMALIZE) \
+					? isub_casefold(c) : c); \
+    } \
+    tt->nchars = start+len; \
+\
+    return add_token(tt, start) || PL_resource_error("memory"); \
+  }
+
+static int
+add_tokenA(const char *s, size_t len, toktype type, void *closure)
+ADD_TOKEN(unsigned char)
+
+static int
+add_tokenW(const wchar_t *s, size_t len, toktype type, void *closure)
+ADD_TOKEN(wchar_t)
+
+
+/* Tokenize t and append the token ids, followed by 0, to tt->ids.
+   *start is set to the offset of the sequence in tt->ids.
+*/
+
+static int
+get_token_ids(term_t t, token_table *tt, size_t *start)
+{ char *s;
+  wchar_t *ws;
+  size_t len;
+
+  *start = tt->nids;
+  if ( PL_get_nchars(t, &len, &s, CVT_ATOMIC|CVT_LIST) )
+  { if ( !tokenizeA(s, len, add_tokenA, tt) )
+      return FALSE;
+  } else if ( PL_get_wchars(t, &len, &ws, CVT_ATOMIC|CVT_LIST|CVT_EXCEPTION) )
+  { if ( !tokenizeW(ws, len, add_tokenW, tt) )
+      return FALSE;
+  } else
+    return FALSE;
+
+  if ( !GROW(tt, ids, tt->nids+1) )
+    return PL_resource_error("memory");
+  tt->ids[tt->nids++] = 0;
+
+  return TRUE;
+}
+
+
+static void
+free_token_table(token_table *tt)
+{ free(tt->chars);
+  free(tt->tokens);
+  free(tt->hash);
+  free(tt->ids);
+}
+
+
+static foreign_t
+pl_isub_tokens(term_t t1, term_t t2, term_t tsim, term_t toptions,
+	       term_t tsubstring_threshold)
+{ isub_params p = ISUB_PARAMS_INIT(0, 0);
+  token_table tt;
+  size_t i1, i2;
+  int rc = FALSE;
+
+  if ( !PL_get_integer_ex(tsubstring_threshold, &p.substring_threshold) ||
+       !PL_get_integer_ex(toptions, &p.options) )
+    return FALSE;
+
+  memset(&tt, 0, sizeof(tt));
+  tt.options = p.options;
+  if ( get_token_ids(t1, &tt, &i1) &&
+       get_token_ids(t2, &tt, &i2) )
+  { double sim = isub_score_tokens(&tt.ids[i1], &tt.ids[i2], &p);
+
+    rc = PL_unify_float(tsim, sim);
+  }
+  free_token_table(&tt);
+
+  return rc;
+}
+
+
+void
+install_isub_tokens(void)
+{ PL_register_foreign("$isub_tokens", 5, pl_isub_tokens, 0);
+}
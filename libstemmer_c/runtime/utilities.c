@@ -209,7 +209,7 @@ extern int eq_v_b(struct SN_env * z, const symbol * p) {
     return eq_s_b(z, SIZE(p), p);
 }
 
-extern int find_among(struct SN_env * z, const struct among * v, int v_size) {
+static int search_among(struct SN_env * z, const struct among * v, int v_size) {
 
     int i = 0;
     int j = v_size;
@@ -267,9 +267,9 @@ extern int find_among(struct SN_env * z, const struct among * v, int v_size) {
     }
 }
 
-/* find_among_b is for backwards processing. Same comments apply */
+/* search_among_b is for backwards processing. Same comments apply */
 
-extern int find_among_b(struct SN_env * z, const struct among * v, int v_size) {
+static int search_among_b(struct SN_env * z, const struct among * v, int v_size) {
 
     int i = 0;
     int j = v_size;
@@ -323,6 +323,247 @@ extern int find_among_b(struct SN_env * z, const struct among * v, int v_size) {
 }
 
 
+/* find_among and find_among_b dispatch through a trie of the strings in v
+   that is built on the first call for v.  Walking the input through the
+   trie yields the longest string in v that matches, after which the
+   substring_i chain is followed as above.  Tries are kept for the lifetime
+   of the process in a table indexed by the address of v, so they are shared
+   by all stemmers and threads.  The binary search above is used if the
+   compiler lacks C11 atomics, if the table is full or if building the trie
+   runs out of memory.
+*/
+
+#if defined(__STDC_VERSION__) && __STDC_VERSION__ >= 201112L && \
+    !defined(__STDC_NO_ATOMICS__)
+#define AMONG_TRIE 1
+#include <stdatomic.h>
+#endif
+
+#ifdef AMONG_TRIE
+
+#define AMONG_TRIE_SLOTS 512            /* power of two */
+
+/* Each node has a dense table of children for the symbols lo..lo+span-1,
+   which is the slice of target starting at base.  Node 0 is the root and
+   a target of 0 means there is no child.
+*/
+
+struct among_node {
+    int among;                          /* string ending here or -1 */
+    int base;                           /* children in target */
+    int lo;                             /* symbol of target[base] */
+    int span;                           /* size of the child table */
+};
+
+struct among_trie {
+    struct among_node * nodes;
+    int * target;
+};
+
+struct among_slot {
+    _Atomic(const struct among *) v;
+    _Atomic(struct among_trie *) trie;
+};
+
+static struct among_slot among_slots[2][AMONG_TRIE_SLOTS];
+static struct among_trie no_trie;       /* build failed; use search_among */
+
+struct among_build {
+    const struct among * v;
+    int * order;                        /* indices of v, sorted on key */
+    int backward;
+    struct among_trie * t;              /* NULL: only count */
+    int nodes;
+    int targets;
+};
+
+/* the i-th symbol of the key of w: reversed for backward tables */
+#define KEY(b, w, i) ((b)->backward ? (w)->s[(w)->s_size - 1 - (i)] : (w)->s[i])
+
+static int compare_among(struct among_build * b, int i1, int i2) {
+    const struct among * w1 = b->v + i1;
+    const struct among * w2 = b->v + i2;
+    int n = w1->s_size < w2->s_size ? w1->s_size : w2->s_size;
+    int i;
+    for (i = 0; i < n; i++) {
+        int diff = KEY(b, w1, i) - KEY(b, w2, i);
+        if (diff != 0) return diff;
+    }
+    return w1->s_size - w2->s_size;
+}
+
+/* Fill node n for the keys order[lo..hi), which share their first depth
+   symbols.  As the keys are sorted, a key of exactly depth symbols comes
+   first and the keys below each child are consecutive.
+*/
+
+static void fill_among_node(struct among_build * b, int n, int lo, int hi, int depth) {
+    struct among_trie * t = b->t;
+    int among = -1;
+    int base = b->targets;
+    int first, i;
+
+    if (lo < hi && b->v[b->order[lo]].s_size == depth) among = b->order[lo++];
+    first = lo < hi ? KEY(b, b->v + b->order[lo], depth) : 0;
+    if (lo < hi) b->targets += KEY(b, b->v + b->order[hi - 1], depth) - first + 1;
+    if (t != NULL) {
+        t->nodes[n].among = among;
+        t->nodes[n].base = base;
+        t->nodes[n].lo = first;
+        t->nodes[n].span = b->targets - base;
+        for (i = base; i < b->targets; i++) t->target[i] = 0;
+    }
+    for (i = lo; i < hi; ) {
+        symbol ch = KEY(b, b->v + b->order[i], depth);
+        int child = b->nodes++;
+        int j = i + 1;
+        while (j < hi && KEY(b, b->v + b->order[j], depth) == ch) j++;
+        if (t != NULL) t->target[base + ch - first] = child;
+        fill_among_node(b, child, i, j, depth + 1);
+        i = j;
+    }
+}
+
+static struct among_trie * build_among_trie(const struct among * v, int v_size, int backward) {
+    struct among_build b;
+    struct among_trie * t;
+    char * mem;
+    int i;
+
+    b.v = v;
+    b.backward = backward;
+    b.order = malloc(v_size * sizeof(int));
+    if (b.order == NULL) return NULL;
+    for (i = 0; i < v_size; i++) {      /* insertion sort: v is nearly sorted */
+        int j = i;
+        while (j > 0 && compare_among(&b, b.order[j - 1], i) > 0) {
+            b.order[j] = b.order[j - 1];
+            j--;
+        }
+        b.order[j] = i;
+    }
+
+    b.t = NULL;                         /* count nodes and targets */
+    b.nodes = 1;
+    b.targets = 0;
+    fill_among_node(&b, 0, 0, v_size, 0);
+    mem = malloc(sizeof(struct among_trie) +
+                 b.nodes * sizeof(struct among_node) +
+                 b.targets * sizeof(int));
+    if (mem == NULL) {
+        free(b.order);
+        return NULL;
+    }
+    t = (struct among_trie *) mem;
+    t->nodes = (struct among_node *) (mem + sizeof(struct among_trie));
+    t->target = (int *) (t->nodes + b.nodes);
+
+    b.t = t;
+    b.nodes = 1;
+    b.targets = 0;
+    fill_among_node(&b, 0, 0, v_size, 0);
+    free(b.order);
+    return t;
+}
+
+/* the trie for v, or NULL if search_among must be used */
+
+static const struct among_trie * get_among_trie(const struct among * v, int v_size, int backward) {
+    struct among_slot * slots = among_slots[backward];
+    unsigned int h = (unsigned int) (((size_t) v >> 4) * 0x9E3779B1U);
+    struct among_trie * t = NULL;
+    int i;
+
+    for (i = 0; i < AMONG_TRIE_SLOTS; i++) {
+        struct among_slot * s = &slots[(h + i) & (AMONG_TRIE_SLOTS - 1)];
+        const struct among * sv = atomic_load_explicit(&s->v, memory_order_acquire);
+
+        if (sv == NULL) {
+            if (t == NULL && (t = build_among_trie(v, v_size, backward)) == NULL)
+                t = &no_trie;
+            if (atomic_compare_exchange_strong(&s->v, &sv, v)) {
+                atomic_store_explicit(&s->trie, t, memory_order_release);
+                return t == &no_trie ? NULL : t;
+            }
+        }
+        if (sv == v) {
+            struct among_trie * st = atomic_load_explicit(&s->trie, memory_order_acquire);
+            if (t != NULL && t != &no_trie) free(t);
+            return st == &no_trie ? NULL : st;
+        }
+    }
+    if (t != NULL && t != &no_trie) free(t);
+    return NULL;
+}
+
+/* index of the longest string in v that matches n symbols at q, stepping
+   dir symbols at a time, or -1 */
+
+static inline int walk_among_trie(const struct among_trie * t, const symbol * q, int n, int dir) {
+    const struct among_node * nd = t->nodes;
+    int m = nd->among;
+
+    for (; n > 0; n--, q += dir) {
+        unsigned int i = (unsigned int) (*q - nd->lo);
+        if (i >= (unsigned int) nd->span || t->target[nd->base + i] == 0) break;
+        nd = t->nodes + t->target[nd->base + i];
+        if (nd->among >= 0) m = nd->among;
+    }
+    return m;
+}
+
+#endif /*AMONG_TRIE*/
+
+extern int find_among(struct SN_env * z, const struct among * v, int v_size) {
+#ifdef AMONG_TRIE
+    const struct among_trie * t = get_among_trie(v, v_size, 0);
+    int c = z->c;
+    int i;
+
+    if (t == NULL) return search_among(z, v, v_size);
+    i = walk_among_trie(t, z->p + c, z->l - c, 1);
+    while (i >= 0) {
+        const struct among * w = v + i;
+        z->c = c + w->s_size;
+        if (w->function == 0) return w->result;
+        {
+            int res = w->function(z);
+            z->c = c + w->s_size;
+            if (res) return w->result;
+        }
+        i = w->substring_i;
+    }
+    return 0;
+#else
+    return search_among(z, v, v_size);
+#endif
+}
+
+extern int find_among_b(struct SN_env * z, const struct among * v, int v_size) {
+#ifdef AMONG_TRIE
+    const struct among_trie * t = get_among_trie(v, v_size, 1);
+    int c = z->c;
+    int i;
+
+    if (t == NULL) return search_among_b(z, v, v_size);
+    i = walk_among_trie(t, z->p + c - 1, c - z->lb, -1);
+    while (i >= 0) {
+        const struct among * w = v + i;
+        z->c = c - w->s_size;
+        if (w->function == 0) return w->result;
+        {
+            int res = w->function(z);
+            z->c = c - w->s_size;
+            if (res) return w->result;
+        }
+        i = w->substring_i;
+    }
+    return 0;
+#else
+    return search_among_b(z, v, v_size);
+#endif
+}
+
 /* Increase the size of the buffer pointed to by p to at least n symbols.
  * If insufficient memory, returns NULL and frees the old buffer.
  */
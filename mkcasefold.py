@@ -0,0 +1,53 @@
+#!/usr/bin/env python3
+# Generate casefold.ic: a two-level table for Unicode simple case folding
+# as used by the isub normalizer.  Usage: python3 mkcasefold.py > casefold.ic
+#
+# Python only provides full case folding.  If the full folding of a code
+# point is a single character, this is also its simple folding.  Else we
+# use the lowercase mapping if this is a single character and leave the
+# code point unchanged otherwise.
+
+import sys
+import unicodedata
+
+BLOCK = 256
+MAXCHR = 0x110000
+
+def fold(c):
+    ch = chr(c)
+    f = ch.casefold()
+    if len(f) == 1:
+        return ord(f)
+    f = ch.lower()
+    if len(f) == 1:
+        return ord(f)
+    return c
+
+blocks = []
+index = []
+for b in range(MAXCHR // BLOCK):
+    deltas = tuple(fold(c) - c for c in range(b*BLOCK, (b+1)*BLOCK))
+    if deltas not in blocks:
+        blocks.append(deltas)
+    index.append(blocks.index(deltas))
+
+out = sys.stdout
+out.write("/* Generated by mkcasefold.py from Unicode %s.  Do not edit.\n"
+          % unicodedata.unidata_version)
+out.write("\n   Simple case folding of c < 0x%x is\n" % MAXCHR)
+out.write("   c + casefold_delta[casefold_index[c>>8]][c&0xff]\n*/\n\n")
+out.write("static const unsigned char casefold_index[%d] =\n{ " % len(index))
+for i, v in enumerate(index):
+    if i and i % 16 == 0:
+        out.write("\n  ")
+    out.write("%d%s" % (v, "," if i+1 < len(index) else ""))
+out.write("\n};\n\n")
+out.write("static const int casefold_delta[%d][%d] =\n{ " % (len(blocks), BLOCK))
+for bi, blk in enumerate(blocks):
+    out.write("{ ")
+    for i, d in enumerate(blk):
+        if i and i % 12 == 0:
+            out.write("\n    ")
+        out.write("%d%s" % (d, "," if i+1 < BLOCK else ""))
+    out.write("\n  }%s" % (",\n  " if bi+1 < len(blocks) else "\n"))
+out.write("};\n")
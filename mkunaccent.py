@@ -0,0 +1,108 @@
+#!/usr/bin/env python3
+# Generate unaccent.ic: a two-level table that maps characters of the
+# Unicode Basic Multilingual Plane to their base letters, as used by
+# unaccent_atom/2 for wide text.  Usage: python3 mkunaccent.py > unaccent.ic
+#
+# A character is mapped if its canonical decomposition (NFD) consists of
+# base characters followed by marks from the combining diacritics blocks.
+# The marks are removed.  Combining diacritics themselves are mapped to
+# the empty string.  ISO Latin-1 follows unaccent_def[] in porter_stem.c
+# and a few letters with a stroke or ligatures are added by hand.
+
+import sys
+import unicodedata
+
+BLOCK = 256
+MAXCHR = 0x10000
+
+DIACRITICS = [(0x0300, 0x036F), (0x1AB0, 0x1AFF), (0x1DC0, 0x1DFF),
+              (0x20D0, 0x20FF), (0xFE20, 0xFE2F)]
+
+LATIN1 = "AAAAAA\0C" "EEEEIIII" "DNOOOOO\0" "\0UUUUY\0\0" \
+         "aaaaaa\0c" "eeeeiiii" "dnooooo\0" "\0uuuuy\0y"
+LATIN1_SPECIAL = {0xC6: "AE", 0xDF: "ss", 0xE6: "ae"}
+
+EXTRA = {0x0110: "D", 0x0111: "d", 0x0126: "H", 0x0127: "h",
+         0x0131: "i", 0x0141: "L", 0x0142: "l", 0x0152: "OE",
+         0x0153: "oe", 0x0166: "T", 0x0167: "t", 0x0180: "b",
+         0x0197: "I", 0x01B5: "Z", 0x01B6: "z", 0x0228: "E",
+         0x0229: "e"}
+
+def diacritic(c):
+    return any(lo <= c <= hi for lo, hi in DIACRITICS)
+
+def unaccent(c):
+    if c < 0xC0:
+        return None
+    if c <= 0xFF:
+        if c in LATIN1_SPECIAL:
+            return LATIN1_SPECIAL[c]
+        m = LATIN1[c-0xC0]
+        return None if m == "\0" else m
+    if c in EXTRA:
+        return EXTRA[c]
+    if 0xD800 <= c <= 0xDFFF:
+        return None
+    if diacritic(c):
+        return ""
+    d = unicodedata.normalize("NFD", chr(c))
+    base = d.rstrip("".join(chr(x) for lo, hi in DIACRITICS
+                            for x in range(lo, hi+1)))
+    if len(base) == len(d) or not base:
+        return None
+    if any(unicodedata.combining(x) for x in base):
+        return None
+    return base
+
+pool = [0]                              # offset 0: no mapping
+offsets = {}
+blocks = []
+index = []
+for b in range(MAXCHR // BLOCK):
+    row = []
+    for c in range(b*BLOCK, (b+1)*BLOCK):
+        m = unaccent(c)
+        if m is None:
+            row.append(0)
+        else:
+            if m not in offsets:
+                offsets[m] = len(pool)
+                pool.append(len(m))
+                pool.extend(ord(x) for x in m)
+            row.append(offsets[m])
+    row = tuple(row)
+    if row not in blocks:
+        blocks.append(row)
+    index.append(blocks.index(row))
+
+assert len(pool) < 0x10000
+
+out = sys.stdout
+out.write("/* Generated by mkunaccent.py from Unicode %s.  Do not edit.\n"
+          % unicodedata.unidata_version)
+out.write("\n   If c < 0x%x and o = unaccent_map[unaccent_index[c>>8]][c&0xff]\n"
+          % MAXCHR)
+out.write("   is not 0, c is replaced by the unaccent_chars[o] characters\n")
+out.write("   that follow unaccent_chars[o].\n*/\n\n")
+out.write("static const unsigned char unaccent_index[%d] =\n{ " % len(index))
+for i, v in enumerate(index):
+    if i and i % 16 == 0:
+        out.write("\n  ")
+    out.write("%d%s" % (v, "," if i+1 < len(index) else ""))
+out.write("\n};\n\n")
+out.write("static const unsigned short unaccent_map[%d][%d] =\n{ "
+          % (len(blocks), BLOCK))
+for bi, blk in enumerate(blocks):
+    out.write("{ ")
+    for i, d in enumerate(blk):
+        if i and i % 12 == 0:
+            out.write("\n    ")
+        out.write("%d%s" % (d, "," if i+1 < BLOCK else ""))
+    out.write("\n  }%s" % (",\n  " if bi+1 < len(blocks) else "\n"))
+out.write("};\n\n")
+out.write("static const unsigned short unaccent_chars[%d] =\n{ " % len(pool))
+for i, v in enumerate(pool):
+    if i and i % 12 == 0:
+        out.write("\n  ")
+    out.write("0x%x%s" % (v, "," if i+1 < len(pool) else ""))
+out.write("\n};\n")
@@ -34,64 +34,535 @@
 
 #define _CRT_SECURE_NO_WARNINGS 1
 #include <config.h>
+#include <SWI-Stream.h>
 #include <SWI-Prolog.h>
+#include <string.h>
+#include <stdlib.h>
 #include "isub.h"
-#include "wcsdup.ic"
 
 /* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
-isub_score_inplace() modifies the contents.  That is why we use
+isub_score_params() modifies the contents.  For atoms and strings,
+PL_get_nchars() and PL_get_wchars() return the text of the object itself,
+so we copy the text into a local buffer or, if it is too long, into a
+malloc'ed buffer.  Most labels are ISO Latin-1,  so we first try to get
+both texts as 8-bit strings and only  use   the  wchar_t  version if one
+of them contains a character above 0xff.
 - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
 
+#define TEXT_FLAGS (CVT_ATOMIC|CVT_LIST|BUF_STACK)
 #define FAST_SIZE 64
 
+/* Copy len characters of size csize from s to a 0-terminated buffer.
+   This is buf if it is large enough.  Free the result if it is not
+   buf.
+*/
+
+static void *
+copy_text(const void *s, size_t len, size_t csize, void *buf)
+{ char *c = buf;
+
+  if ( len+1 > FAST_SIZE && !(c = PL_malloc((len+1)*csize)) )
+  { PL_resource_error("memory");
+    return NULL;
+  }
+  memcpy(c, s, len*csize);
+  memset(c+len*csize, 0, csize);
+
+  return c;
+}
+
+/* Score the texts t1 and t2.  See isub_score_normalized() for the
+   meaning of p->min_score.
+*/
+
 static int
-get_chars(term_t t, wchar_t **sb, wchar_t *buf)
-{ wchar_t *s;
-  size_t len;
+isub_texts(term_t t1, term_t t2, const isub_params *p, double *sim)
+{ char *s1, *s2;
+  wchar_t *w1, *w2;
+  size_t l1, l2;
+  wchar_t buf1[FAST_SIZE];
+  wchar_t buf2[FAST_SIZE];
+  void *c1 = NULL, *c2 = NULL;
+  int rc = FALSE;
 
-  if ( PL_get_wchars(t, &len, &s, CVT_ATOMIC|CVT_LIST|CVT_EXCEPTION) )
-  { if ( len+1 < FAST_SIZE )
-    { *sb = wcscpy(buf, s);
-    } else
-    { if ( !(*sb = wcsdup(s)) )
-	return FALSE;
+  if ( PL_get_nchars(t1, &l1, &s1, TEXT_FLAGS) &&
+       PL_get_nchars(t2, &l2, &s2, TEXT_FLAGS) )
+  { if ( (c1=copy_text(s1, l1, sizeof(char), buf1)) &&
+	 (c2=copy_text(s2, l2, sizeof(char), buf2)) )
+    { *sim = isub_score_paramsA(c1, c2, p);
+      rc = TRUE;
+    }
+  } else if ( PL_get_wchars(t1, &l1, &w1, TEXT_FLAGS|CVT_EXCEPTION) &&
+	      PL_get_wchars(t2, &l2, &w2, TEXT_FLAGS|CVT_EXCEPTION) )
+  { if ( (c1=copy_text(w1, l1, sizeof(wchar_t), buf1)) &&
+	 (c2=copy_text(w2, l2, sizeof(wchar_t), buf2)) )
+    { *sim = isub_score_params(c1, c2, p);
+      rc = TRUE;
     }
+  }
+
+  if ( c1 && c1 != (void*)buf1 ) PL_free(c1);
+  if ( c2 && c2 != (void*)buf2 ) PL_free(c2);
+
+  return rc;
+}
+
+
+static foreign_t
+pl_isub(term_t t1, term_t t2, term_t tsim, term_t toptions, term_t tsubstring_threshold)
+{ isub_params p = ISUB_PARAMS_INIT(0, 2);
+  double sim;
+
+  return ( PL_get_integer_ex(tsubstring_threshold, &p.substring_threshold) &&
+	   PL_get_integer_ex(toptions, &p.options) &&
+	   isub_texts(t1, t2, &p, &sim) &&
+	   PL_unify_float(tsim, sim) );
+}
+
+
+static atom_t ATOM_infinite;
+static functor_t FUNCTOR_minus2;
+
+/* As pl_isub(), but limit the work to max_work and report the work
+   done.  If on_error is 1, running out of work raises a resource error
+   rather than returning a lower bound.
+*/
+
+static foreign_t
+pl_isub_work(term_t t1, term_t t2, term_t tsim, term_t toptions,
+	     term_t tsubstring_threshold, term_t tmax_work, term_t ton_error,
+	     term_t twork)
+{ isub_params p = ISUB_PARAMS_INIT(0, 2);
+  isub_work work;
+  int on_error;
+  double sim;
+  atom_t a;
+
+  if ( PL_get_atom(tmax_work, &a) && a == ATOM_infinite )
+  { p.max_work = 0;
+  } else if ( !PL_get_size_ex(tmax_work, &p.max_work) )
+  { return FALSE;
+  } else if ( p.max_work == 0 )
+  { return PL_domain_error("positive_integer", tmax_work);
+  }
+
+  p.work = &work;
+  if ( !PL_get_integer_ex(tsubstring_threshold, &p.substring_threshold) ||
+       !PL_get_integer_ex(toptions, &p.options) ||
+       !PL_get_bool_ex(ton_error, &on_error) ||
+       !isub_texts(t1, t2, &p, &sim) )
+    return FALSE;
+
+  if ( work.exhausted && on_error )
+    return PL_resource_error("isub_work");
+
+  return ( PL_unify_float(tsim, sim) &&
+	   PL_unify_int64(twork, (int64_t)work.used) );
+}
+
 
+		 /*******************************
+		 *	  PREPARED QUERIES	*
+		 *******************************/
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+An isub_query blob holds a normalized  query   text,  so we can score it
+against many candidates without redoing the  normalization and the text
+conversion of the query.  The query is  always kept as wchar_t text and,
+if possible, also as ISO Latin-1 text.   It also holds the set of
+characters removed when normalizing the candidates.
+- - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+typedef struct isub_query
+{ int		options;
+  int		substring_threshold;
+  size_t	len;			/* length of the (normalized) text */
+  char	       *text;			/* ISO Latin-1 text or NULL */
+  wchar_t      *wtext;			/* Wide character text */
+  isub_charset	remove;			/* removed by NORMALIZE */
+} isub_query;
+
+static int
+release_isub_query(atom_t symbol)
+{ isub_query **qp = PL_blob_data(symbol, NULL, NULL);
+  isub_query *q = *qp;
+
+  if ( q->text )
+    PL_free(q->text);
+  PL_free(q->wtext);
+  isub_charset_destroy(&q->remove);
+  PL_free(q);
+
+  return TRUE;
+}
+
+static int
+write_isub_query(IOSTREAM *s, atom_t symbol, int flags)
+{ isub_query **qp = PL_blob_data(symbol, NULL, NULL);
+
+  Sfprintf(s, "<isub_query>(%p)", *qp);
+  return TRUE;
+}
+
+static PL_blob_t isub_query_blob =
+{ PL_BLOB_MAGIC,
+  PL_BLOB_NOCOPY,
+  "isub_query",
+  release_isub_query,
+  NULL,
+  write_isub_query
+};
+
+
+static int
+get_isub_query(term_t t, isub_query **qp)
+{ void *data;
+  PL_blob_t *type;
+
+  if ( PL_get_blob(t, &data, NULL, &type) && type == &isub_query_blob )
+  { isub_query **ref = data;
+
+    *qp = *ref;
     return TRUE;
   }
 
-  return FALSE;
+  return PL_type_error("isub_query", t);
 }
 
 
 static foreign_t
-pl_isub(term_t t1, term_t t2, term_t tsim, term_t toptions, term_t tsubstring_threshold)
-{ wchar_t buf1[FAST_SIZE];
-  wchar_t buf2[FAST_SIZE];
-  wchar_t *s1=NULL, *s2=NULL;
-  int rc;
-  int options;
-  int substring_threshold;
+pl_isub_prepare(term_t text, term_t toptions, term_t tsubstring_threshold,
+		term_t tremove, term_t handle)
+{ wchar_t *ws, *rs;
+  size_t len, rlen;
+  int options, substring_threshold;
+  isub_charset remove;
+  isub_query *q;
 
-  if ( !get_chars(t1, &s1, buf1) ||
-       !get_chars(t2, &s2, buf2) ||
+  if ( !PL_get_wchars(text, &len, &ws, TEXT_FLAGS|CVT_EXCEPTION) ||
+       !PL_get_wchars(tremove, &rlen, &rs, TEXT_FLAGS|CVT_EXCEPTION) ||
        !PL_get_integer_ex(tsubstring_threshold, &substring_threshold) ||
        !PL_get_integer_ex(toptions, &options) )
-  { rc = FALSE;
-    goto out;
+    return FALSE;
+
+  if ( !isub_charset_init(&remove, rs, rlen) )
+    return PL_resource_error("memory");
+
+  if ( !(q=PL_malloc(sizeof(*q))) ||
+       !(q->wtext=PL_malloc((len+1)*sizeof(wchar_t))) )
+  { if ( q )
+      PL_free(q);
+    isub_charset_destroy(&remove);
+    return PL_resource_error("memory");
+  }
+  memcpy(q->wtext, ws, len*sizeof(wchar_t));	/* ws is the text of an atom */
+  q->wtext[len] = 0;
+  if ( (options&NORMALIZE) )
+    len = isub_normalize_set(q->wtext, &remove);
+
+  q->remove = remove;
+  q->options = options;
+  q->substring_threshold = substring_threshold;
+  q->len = len;
+  q->text = NULL;
+  { size_t i;
+
+    for(i=0; i<len && q->wtext[i] <= 0xff; i++)
+      ;
+    if ( i == len && (q->text=PL_malloc(len+1)) )
+    { for(i=0; i<=len; i++)
+	q->text[i] = (char)q->wtext[i];
+    }
+  }
+
+  return PL_unify_blob(handle, &q, sizeof(q), &isub_query_blob);
+}
+
+
+/* A scratch buffer that we reuse while scoring many candidates
+*/
+
+typedef struct scratch
+{ void   *data;
+  size_t  size;
+} scratch;
+
+static void *
+scratch_get(scratch *b, size_t size)
+{ if ( size > b->size )
+  { void *n = PL_realloc(b->data, size);
+
+    if ( !n )
+    { PL_resource_error("memory");
+      return NULL;
+    }
+    b->data = n;
+    b->size = size;
+  }
+
+  return b->data;
+}
+
+static void
+scratch_free(scratch *b)
+{ if ( b->data )
+    PL_free(b->data);
+}
+
+
+/* Score a prepared query against a candidate using the scratch buffers
+   qb and cb.  See isub_score_normalized() for min_score.
+*/
+
+static int
+isub_query_score(isub_query *q, term_t cand, scratch *qb, scratch *cb,
+		 double min_score, double *sim)
+{ isub_params p = ISUB_PARAMS_INIT(q->options, q->substring_threshold);
+  char *s;
+  wchar_t *ws;
+  size_t len;
+
+  p.min_score = min_score;
+  p.remove = &q->remove;
+  if ( q->text && PL_get_nchars(cand, &len, &s, CVT_ATOMIC|CVT_LIST) )
+  { char *s1, *s2;
+
+    if ( !(s1=scratch_get(qb, q->len+1)) ||
+	 !(s2=scratch_get(cb, len+1)) )
+      return FALSE;
+    memcpy(s1, q->text, q->len+1);
+    memcpy(s2, s, len);
+    s2[len] = 0;
+    if ( (q->options&NORMALIZE) )
+      isub_normalize_setA(s2, &q->remove);
+    *sim = isub_score_normalizedA(s1, s2, &p);
+  } else if ( PL_get_wchars(cand, &len, &ws, CVT_ATOMIC|CVT_LIST|CVT_EXCEPTION) )
+  { wchar_t *s1, *s2;
+
+    if ( !(s1=scratch_get(qb, (q->len+1)*sizeof(wchar_t))) ||
+	 !(s2=scratch_get(cb, (len+1)*sizeof(wchar_t))) )
+      return FALSE;
+    memcpy(s1, q->wtext, (q->len+1)*sizeof(wchar_t));
+    memcpy(s2, ws, len*sizeof(wchar_t));
+    s2[len] = 0;
+    if ( (q->options&NORMALIZE) )
+      isub_normalize_set(s2, &q->remove);
+    *sim = isub_score_normalized(s1, s2, &p);
+  } else
+    return FALSE;
+
+  return TRUE;
+}
+
+
+static foreign_t
+pl_isub_many(term_t handle, term_t candidates, term_t scores)
+{ isub_query *q;
+  term_t tail = PL_copy_term_ref(candidates);
+  term_t head = PL_new_term_ref();
+  term_t stail = PL_copy_term_ref(scores);
+  term_t shead = PL_new_term_ref();
+  scratch qb = {0}, cb = {0};
+  int rc = TRUE;
+
+  if ( !get_isub_query(handle, &q) )
+    return FALSE;
+
+  while( rc && PL_get_list_ex(tail, head, tail) )
+  { double sim;
+
+    rc = ( isub_query_score(q, head, &qb, &cb, -HUGE_VAL, &sim) &&
+	   PL_unify_list(stail, shead, stail) &&
+	   PL_unify_float(shead, sim) );
   }
+  scratch_free(&qb);
+  scratch_free(&cb);
+
+  return rc && PL_get_nil_ex(tail) && PL_unify_nil(stail);
+}
+
 
-  rc = PL_unify_float(tsim, isub_score_inplace(s1, s2, options, substring_threshold));
+		 /*******************************
+		 *	   BOUNDED SEARCH	*
+		 *******************************/
 
-out:
-  if ( s1 && s1 != buf1 ) PL_free(s1);
-  if ( s2 && s2 != buf2 ) PL_free(s2);
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+isub_best/4 keeps the K best candidates  in   a  min-heap.  Once the heap
+is full, the score of its root is   passed  as minimal score, such that
+isub_score_normalized() skips candidates  whose   length  and prefix bound
+cannot beat it and gives up  on  others   as  soon  as the remaining text
+cannot lift the score far enough.   On  equal scores the earlier candidate
+wins.
+- - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+typedef struct ranked
+{ double	score;
+  size_t	index;			/* index in the candidate list */
+  term_t	candidate;
+} ranked;
+
+static int
+ranked_worse(const ranked *r1, const ranked *r2)
+{ return ( r1->score < r2->score ||
+	   (r1->score == r2->score && r1->index > r2->index) );
+}
+
+static void
+heap_down(ranked *heap, size_t size, size_t i)
+{ for(;;)
+  { size_t l = 2*i+1, r = l+1, m = i;
+
+    if ( l < size && ranked_worse(&heap[l], &heap[m]) )
+      m = l;
+    if ( r < size && ranked_worse(&heap[r], &heap[m]) )
+      m = r;
+    if ( m == i )
+      break;
+    { ranked tmp = heap[i]; heap[i] = heap[m]; heap[m] = tmp; }
+    i = m;
+  }
+}
+
+static void
+heap_up(ranked *heap, size_t i)
+{ while ( i > 0 )
+  { size_t parent = (i-1)/2;
+
+    if ( !ranked_worse(&heap[i], &heap[parent]) )
+      break;
+    { ranked tmp = heap[i]; heap[i] = heap[parent]; heap[parent] = tmp; }
+    i = parent;
+  }
+}
+
+static int
+compare_ranked(const void *p1, const void *p2)
+{ const ranked *r1 = p1;
+  const ranked *r2 = p2;
+
+  return ranked_worse(r1, r2) ? 1 : ranked_worse(r2, r1) ? -1 : 0;
+}
+
+
+static foreign_t
+pl_isub_best(term_t handle, term_t candidates, term_t tk, term_t tranked)
+{ isub_query *q;
+  term_t tail = PL_copy_term_ref(candidates);
+  term_t head = PL_new_term_ref();
+  size_t k, len, count = 0, index = 0;
+  ranked *heap = NULL;
+  term_t refs = 0;
+  scratch qb = {0}, cb = {0};
+  int rc = TRUE;
+
+  if ( !get_isub_query(handle, &q) ||
+       !PL_get_size_ex(tk, &k) )
+    return FALSE;
+  if ( PL_skip_list(candidates, 0, &len) != PL_LIST )
+    return PL_type_error("list", candidates);
+  if ( k > len )
+    k = len;
+  if ( k > 0 )
+  { if ( !(refs = PL_new_term_refs(k)) )
+      return FALSE;
+    if ( !(heap = malloc(k*sizeof(*heap))) )
+      return PL_resource_error("memory");
+  }
+
+  for(; rc && k > 0 && PL_get_list(tail, head, tail); index++)
+  { double min_score = count == k ? heap[0].score : -HUGE_VAL;
+    double sim;
+
+    if ( !(rc=isub_query_score(q, head, &qb, &cb, min_score, &sim)) )
+      break;
+    if ( count < k )
+    { heap[count].score = sim;
+      heap[count].index = index;
+      heap[count].candidate = refs+count;
+      PL_put_term(heap[count].candidate, head);
+      heap_up(heap, count++);
+    } else if ( sim > heap[0].score )
+    { heap[0].score = sim;
+      heap[0].index = index;
+      PL_put_term(heap[0].candidate, head);
+      heap_down(heap, count, 0);
+    }
+  }
+  scratch_free(&qb);
+  scratch_free(&cb);
+
+  if ( rc )
+  { term_t rtail = PL_copy_term_ref(tranked);
+    term_t rhead = PL_new_term_ref();
+    size_t i;
+
+    if ( count > 0 )
+      qsort(heap, count, sizeof(*heap), compare_ranked);
+    for(i=0; rc && i<count; i++)
+    { rc = ( PL_unify_list(rtail, rhead, rtail) &&
+	     PL_unify_term(rhead, PL_FUNCTOR, FUNCTOR_minus2,
+				    PL_FLOAT, heap[i].score,
+				    PL_TERM, heap[i].candidate) );
+    }
+    rc = rc && PL_unify_nil(rtail);
+  }
+  if ( heap )
+    free(heap);
 
   return rc;
 }
 
 
+static foreign_t
+pl_isub_above(term_t t1, term_t t2, term_t tthreshold, term_t tsim)
+{ PL_blob_t *type;
+  double threshold, sim;
+
+  if ( !PL_get_float_ex(tthreshold, &threshold) )
+    return FALSE;
+
+  if ( PL_is_blob(t1, &type) && type == &isub_query_blob )
+  { isub_query *q;
+    scratch qb = {0}, cb = {0};
+    int rc;
+
+    rc = ( get_isub_query(t1, &q) &&
+	   isub_query_score(q, t2, &qb, &cb, threshold, &sim) );
+    scratch_free(&qb);
+    scratch_free(&cb);
+    if ( !rc )
+      return FALSE;
+  } else
+  { isub_params p = ISUB_PARAMS_INIT(0, 2);
+
+    p.min_score = threshold;
+    if ( !isub_texts(t1, t2, &p, &sim) )
+      return FALSE;
+  }
+
+  return sim >= threshold && PL_unify_float(tsim, sim);
+}
+
+
+void install_isub_index(void);
+void install_isub_join(void);
+void install_isub_tokens(void);
+void install_isub_dict(void);
+
 install_t
 install_isub()
-{ PL_register_foreign("$isub", 5, pl_isub, 0);
+{ ATOM_infinite  = PL_new_atom("infinite");
+  FUNCTOR_minus2 = PL_new_functor(PL_new_atom("-"), 2);
+
+  PL_register_foreign("$isub", 5, pl_isub, 0);
+  PL_register_foreign("$isub_work", 8, pl_isub_work, 0);
+  PL_register_foreign("$isub_prepare", 5, pl_isub_prepare, 0);
+  PL_register_foreign("isub_many", 3, pl_isub_many, 0);
+  PL_register_foreign("$isub_best", 4, pl_isub_best, 0);
+  PL_register_foreign("isub_above", 4, pl_isub_above, 0);
+
+  install_isub_index();
+  install_isub_join();
+  install_isub_tokens();
+  install_isub_dict();
 }
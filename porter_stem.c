@@ -27,14 +27,28 @@
 */
 
 #include <config.h>
+#include <SWI-Stream.h>
 #include <SWI-Prolog.h>
 
 #include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
 #include <string.h>
+#include <errno.h>
 #include <ctype.h>
 #include <wctype.h>
 #include <wchar.h>
 
+#ifdef _MSC_VER
+#define __thread __declspec(thread)
+#endif
+
+#include "text_type.ic"
+#include "stopwords.ic"
+#include "unaccent.ic"
+#include "casefold.ic"
+#include "normalize.ic"
+
 /* The main part of the stemming algorithm starts here. b is a buffer
    holding a word to be stemmed. The letters are in b[k0], b[k0+1] ...
    ending at b[k]. In fact k0 = 0 in this demo program. k is readjusted
@@ -371,23 +385,265 @@ stem(char * p, int i, int j)
 
 /* SWI-Prolog hooks */
 
-static int unaccent(const char *in, size_t len, char *out, size_t size);
+		 /*******************************
+		 *	       MEMO		*
+		 *******************************/
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+porter_stem/2 on an atom  is  memoized  in   a  per-thread  table from the
+input atom to the stem atom.   The  table  has  a  fixed  number  of
+entries, chained from a hash  table  on   the  input  atom.  When full,
+entries are replaced using  the  CLOCK   algorithm:  a  hand cycles over
+the entries, clearing the referenced flag of recently used entries and
+evicting the first one that  is  not   referenced.  Both  atoms of an
+entry are registered.
+
+The number of entries  is  process-wide   and  set  using
+set_porter_stem_cache_size/1. Each thread adjusts  its table on the next
+call.
+- - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+#define MEMO_DEFAULT_SIZE 4096
+
+typedef struct memo_entry
+{ atom_t	word;			/* input atom */
+  atom_t	stem;			/* its stem */
+  int		next;			/* next in bucket or -1 */
+  int		referenced;		/* CLOCK reference flag */
+} memo_entry;
+
+typedef struct stem_memo
+{ size_t	size;			/* # entries (power of 2) */
+  size_t	count;			/* # entries in use */
+  size_t	hand;			/* CLOCK hand */
+  int	       *buckets;
+  memo_entry   *entries;
+  int64_t	hits;
+  int64_t	misses;
+  int64_t	evictions;
+} stem_memo;
+
+static size_t memo_size = MEMO_DEFAULT_SIZE;
+static __thread stem_memo *memo_ptr = NULL;
+
+#define MEMO_HASH(a, size) ((size_t)((a)>>7) & ((size)-1))
+
+static void
+memo_clear(stem_memo *memo)
+{ size_t i;
+
+  for(i=0; i<memo->count; i++)
+  { PL_unregister_atom(memo->entries[i].word);
+    PL_unregister_atom(memo->entries[i].stem);
+  }
+  for(i=0; i<memo->size; i++)
+    memo->buckets[i] = -1;
+  memo->count = 0;
+  memo->hand = 0;
+}
+
+static void
+memo_free(stem_memo *memo)
+{ memo_clear(memo);
+  free(memo->buckets);
+  free(memo->entries);
+  free(memo);
+}
+
+static void
+stem_destroy_memo(void *closure)
+{ stem_memo *memo = memo_ptr;
+
+  if ( memo )
+  { memo_free(memo);
+    memo_ptr = NULL;
+  }
+}
+
+static stem_memo *
+get_memo(void)
+{ stem_memo *memo = memo_ptr;
+  size_t size = memo_size;
+
+  if ( memo && memo->size == size )
+    return memo;
+  if ( memo )
+  { memo_free(memo);
+    memo_ptr = NULL;
+  }
+  if ( size == 0 )
+    return NULL;
+
+  if ( (memo = calloc(1, sizeof(*memo))) )
+  { memo->size = size;
+    if ( !(memo->buckets = malloc(size*sizeof(*memo->buckets))) ||
+	 !(memo->entries = malloc(size*sizeof(*memo->entries))) )
+    { free(memo->buckets);
+      free(memo);
+      return NULL;
+    }
+    memo_clear(memo);
+    memo_ptr = memo;
+  }
+
+  return memo;
+}
+
+static atom_t
+memo_lookup(stem_memo *memo, atom_t word)
+{ int i;
+
+  for(i=memo->buckets[MEMO_HASH(word, memo->size)]; i >= 0;
+      i=memo->entries[i].next)
+  { memo_entry *e = &memo->entries[i];
+
+    if ( e->word == word )
+    { e->referenced = TRUE;
+      memo->hits++;
+      return e->stem;
+    }
+  }
+
+  memo->misses++;
+  return (atom_t)0;
+}
+
+static void
+memo_unlink(stem_memo *memo, int i)
+{ int *p = &memo->buckets[MEMO_HASH(memo->entries[i].word, memo->size)];
+
+  while ( *p != i )
+    p = &memo->entries[*p].next;
+  *p = memo->entries[i].next;
+}
+
+static void
+memo_add(stem_memo *memo, atom_t word, atom_t stem)
+{ memo_entry *e;
+  size_t k;
+  int i;
+
+  if ( memo->count < memo->size )
+  { i = (int)memo->count++;
+  } else
+  { for(;;)
+    { e = &memo->entries[memo->hand];
+      memo->hand = (memo->hand+1) & (memo->size-1);
+      if ( e->referenced )
+	e->referenced = FALSE;
+      else
+	break;
+    }
+    i = (int)(e-memo->entries);
+    memo_unlink(memo, i);
+    PL_unregister_atom(e->word);
+    PL_unregister_atom(e->stem);
+    memo->evictions++;
+  }
+
+  e = &memo->entries[i];
+  k = MEMO_HASH(word, memo->size);
+  PL_register_atom(word);
+  PL_register_atom(stem);
+  e->word = word;
+  e->stem = stem;
+  e->referenced = FALSE;
+  e->next = memo->buckets[k];
+  memo->buckets[k] = i;
+}
+
+
+static int stem_chars(const char *word, size_t len, term_t t_stem,
+		      int type);
+
+static int
+stem_atom_memo(atom_t a, term_t t_stem)
+{ stem_memo *memo = get_memo();
+  atom_t stem;
+  const char *word;
+  size_t len;
+  term_t tmp;
+
+  if ( !memo || !(word = PL_atom_nchars(a, &len)) )
+    return -1;
+  if ( (stem=memo_lookup(memo, a)) )
+    return PL_unify_atom(t_stem, stem);
+
+  if ( !(tmp = PL_new_term_ref()) ||
+       !stem_chars(word, len, tmp, PL_ATOM) ||
+       !PL_get_atom(tmp, &stem) )
+    return FALSE;
+  memo_add(memo, a, stem);
+
+  return PL_unify_atom(t_stem, stem);
+}
+
 
 static foreign_t
-pl_stem(term_t t_in, term_t t_stem)
-{ char *word;
-  size_t len, end;
-  char *f, *t, *s, *ew;
+pl_set_stem_cache_size(term_t t_size)
+{ size_t size, p2;
+
+  if ( !PL_get_size_ex(t_size, &size) )
+    return FALSE;
+  if ( size > 0x10000000 )
+    return PL_domain_error("porter_stem_cache_size", t_size);
+  for(p2=size ? 1 : 0; p2 < size; p2 *= 2)
+    ;
+  memo_size = p2;
+
+  return TRUE;
+}
+
+
+static foreign_t
+pl_stem_cache_clear(void)
+{ stem_memo *memo = memo_ptr;
+
+  if ( memo )
+  { memo_clear(memo);
+    memo->hits = memo->misses = memo->evictions = 0;
+  }
+
+  return TRUE;
+}
+
+
+static foreign_t
+pl_stem_cache_stats(term_t stats)
+{ stem_memo *memo = memo_ptr;
+  int64_t count = 0, hits = 0, misses = 0, evictions = 0;
+
+  if ( memo && memo->size == memo_size )
+  { count     = (int64_t)memo->count;
+    hits      = memo->hits;
+    misses    = memo->misses;
+    evictions = memo->evictions;
+  }
+
+  return PL_unify_term(stats,
+		       PL_FUNCTOR_CHARS, "porter_stem_cache", 5,
+			 PL_INT64, (int64_t)memo_size,
+			 PL_INT64, count,
+			 PL_INT64, hits,
+			 PL_INT64, misses,
+			 PL_INT64, evictions);
+}
+
+
+static int unaccent(const char *in, size_t len, char *out, size_t size);
+static char *unaccent_narrowW(const wchar_t *s, size_t len,
+			      char *buf, size_t size, size_t *olen);
+
+static int
+stem_chars(const char *word, size_t len, term_t t_stem, int type)
+{ size_t end;
+  const char *f, *ew;
+  char *t, *s;
   char buf[1024];
   char plain[1024];
   long l;
   int rc;
 
-  if ( !PL_get_nchars(t_in, &len, &word, CVT_ALL|CVT_EXCEPTION) )
-  { if ( PL_is_number(t_in) )
-      return PL_unify(t_in, t_stem);
-    return FALSE;
-  }
   ew = &word[len];
   s = len+1 > sizeof(buf) ? PL_malloc(len+1) : buf;
   for(f=word, t=s; f<ew; )
@@ -398,6 +654,7 @@ pl_stem(term_t t_in, term_t t_stem)
     { if ( s != buf )
 	PL_free(s);
       s = plain;
+      len = l;
     }
   } else
   { char *s2 = PL_malloc(l+1);
@@ -405,12 +662,13 @@ pl_stem(term_t t_in, term_t t_stem)
     if ( s != buf )
       PL_free(s);
     s = s2;
+    len = l;
   }
 
   end = stem(s, 0, (int)(len - 1));
   s[end + 1] = '\0';
 
-  rc = PL_unify_atom_chars(t_stem, s);
+  rc = PL_unify_chars(t_stem, type, (size_t)-1, s);
   if ( s != plain && s != buf )
     PL_free(s);
 
@@ -418,6 +676,103 @@ pl_stem(term_t t_in, term_t t_stem)
 }
 
 
+/* Text that contains characters outside ISO Latin-1 after removing
+   accents is not stemmed.  We remove the accents and downcase it using
+   the Unicode tables, such that the result does not depend on the
+   locale.
+*/
+
+static int
+unify_downcaseW(term_t t, const wchar_t *s, size_t len, int type)
+{ wchar_t buf[256];
+  wchar_t *d = buf;
+  size_t n;
+  int rc;
+
+  if ( (n=normalize_text(s, len, NORM_CASEFOLD|NORM_UNACCENT,
+			 d, sizeof(buf)/sizeof(wchar_t))) >
+       sizeof(buf)/sizeof(wchar_t) )
+  { d = PL_malloc(n*sizeof(wchar_t));
+    normalize_text(s, len, NORM_CASEFOLD|NORM_UNACCENT, d, n);
+  }
+  rc = PL_unify_wchars(t, type, n, d);
+  if ( d != buf )
+    PL_free(d);
+
+  return rc;
+}
+
+
+static int
+stem_text(term_t t_in, term_t t_stem, int type)
+{ char *word;
+  wchar_t *wword;
+  size_t len;
+  atom_t a;
+
+  if ( type == PL_ATOM && PL_get_atom(t_in, &a) )
+  { int rc = stem_atom_memo(a, t_stem);
+
+    if ( rc >= 0 )
+      return rc;
+  }
+  if ( PL_get_nchars(t_in, &len, &word, CVT_ALL) )
+    return stem_chars(word, len, t_stem, type);
+  if ( !PL_get_wchars(t_in, &len, &wword, CVT_ALL|CVT_EXCEPTION) )
+    return FALSE;
+
+  { char tmp[1024];
+    size_t nlen;
+    int rc;
+
+    if ( (word=unaccent_narrowW(wword, len, tmp, sizeof(tmp), &nlen)) )
+    { rc = stem_chars(word, nlen, t_stem, type);
+      if ( word != tmp )
+	PL_free(word);
+      return rc;
+    }
+  }
+
+  return unify_downcaseW(t_stem, wword, len, type);
+}
+
+
+static foreign_t
+pl_stem(term_t t_in, term_t t_stem)
+{ return stem_text(t_in, t_stem, PL_ATOM);
+}
+
+
+static foreign_t
+pl_stem3(term_t t_in, term_t t_stem, term_t options)
+{ int type;
+
+  return ( get_text_type(options, &type) &&
+	   stem_text(t_in, t_stem, type) );
+}
+
+
+/* porter_stem_list(+Words, -Stems) walks Words once, reusing the term
+   references and the per-thread memo for all elements.
+*/
+
+static foreign_t
+pl_stem_list(term_t words, term_t stems)
+{ term_t tail = PL_copy_term_ref(words);
+  term_t head = PL_new_term_ref();
+  term_t stail = PL_copy_term_ref(stems);
+  term_t shead = PL_new_term_ref();
+  int rc = TRUE;
+
+  while( rc && PL_get_list_ex(tail, head, tail) )
+  { rc = ( PL_unify_list(stail, shead, stail) &&
+	   stem_text(head, shead, PL_ATOM) );
+  }
+
+  return rc && PL_get_nil_ex(tail) && PL_unify_nil(stail);
+}
+
+
 		 /*******************************
 		 *	       ACCENTS		*
 		 *******************************/
@@ -445,11 +800,48 @@ static char *unaccent_def[] =
 };
 
 
+/* unaccent_skip() returns the offset of the first byte that may carry an
+   accent, i.e., the first byte >= 192, or len if there is none.  Blocks
+   of 32 bytes are tested as four 64-bit words: a byte is >= 192 iff both
+   its top bits are set.
+*/
+
+#define ACCENT_MASK 0x8080808080808080ULL
+
+static size_t
+unaccent_skip(const char *in, size_t len)
+{ size_t i = 0;
+
+  for( ; i+32 <= len; i += 32)
+  { uint64_t w[4], acc;
+
+    memcpy(w, in+i, sizeof(w));
+    acc = ( (w[0] & (w[0]<<1)) | (w[1] & (w[1]<<1)) |
+	    (w[2] & (w[2]<<1)) | (w[3] & (w[3]<<1)) );
+    if ( acc & ACCENT_MASK )
+      break;
+  }
+  for( ; i < len; i++)
+  { if ( (in[i]&0xff) >= 192 )
+      break;
+  }
+
+  return i;
+}
+
+
 static int
 unaccent(const char *in, size_t len, char *out, size_t size)
 { char *to = out, *toe = &out[size];
   const char *ein = &in[len];
   int changes = 0;
+  size_t skip = unaccent_skip(in, len);
+
+  if ( skip > 0 )			/* copy the plain prefix */
+  { memcpy(out, in, skip < size ? skip : size);
+    to += skip;
+    in += skip;
+  }
 
   for( ; in < ein; in++)
   { int c = (*in)&0xff;
@@ -481,6 +873,124 @@ unaccent(const char *in, size_t len, char *out, size_t size)
 }
 
 
+/* Wide version of unaccent(), removing accents from all characters in
+   the Basic Multilingual Plane.  The table is generated by
+   mkunaccent.py.
+*/
+
+static int
+unaccentW(const wchar_t *in, size_t len, wchar_t *out, size_t size)
+{ wchar_t *to = out, *toe = &out[size];
+  const wchar_t *ein = &in[len];
+  int changes = 0;
+
+  for( ; in < ein; in++)
+  { wchar_t c = *in;
+    unsigned int uc = (unsigned int)c;
+    unsigned int o;
+
+    if ( uc >= 0x10000 ||
+	 !(o=unaccent_map[unaccent_index[uc>>8]][uc&0xff]) )
+    { if ( to < toe )
+	*to = c;
+      to++;
+    } else
+    { const unsigned short *m = &unaccent_chars[o+1];
+      unsigned int n = unaccent_chars[o];
+
+      changes++;
+      while(n-- > 0)
+      { if ( to < toe )
+	  *to = *m;
+	to++;
+	m++;
+      }
+    }
+  }
+
+  if ( to < toe )
+    *to = '\0';
+
+  if ( changes == 0 )
+    return (int)(out-to);		/* no change: negative */
+
+  return (int)(to-out);
+}
+
+
+/* Remove accents from wide text.  If the result fits ISO Latin-1, return
+   it as a 0-terminated string in buf or, if it does not fit, a
+   PL_malloc()'ed string.  Else return NULL.
+*/
+
+static char *
+unaccent_narrowW(const wchar_t *s, size_t len, char *buf, size_t size,
+		 size_t *olen)
+{ wchar_t tmp[1024];
+  wchar_t *w = tmp;
+  const wchar_t *plain;
+  char *out = NULL;
+  size_t i;
+  int l;
+
+  if ( (l=unaccentW(s, len, w, sizeof(tmp)/sizeof(wchar_t))) < 0 )
+  { plain = s;
+    l = (int)len;
+  } else
+  { if ( l >= (int)(sizeof(tmp)/sizeof(wchar_t)) )
+    { w = PL_malloc((l+1)*sizeof(wchar_t));
+      unaccentW(s, len, w, l+1);
+    }
+    plain = w;
+  }
+
+  for(i=0; i<(size_t)l; i++)
+  { if ( plain[i] > 0xff )
+      goto out;
+  }
+
+  out = (size_t)l+1 > size ? PL_malloc(l+1) : buf;
+  for(i=0; i<(size_t)l; i++)
+    out[i] = (char)plain[i];
+  out[l] = '\0';
+  *olen = l;
+
+out:
+  if ( w != tmp )
+    PL_free(w);
+
+  return out;
+}
+
+
+static int
+unaccent_wide(term_t from, term_t to)
+{ wchar_t buf[1024];
+  wchar_t *f;
+  int len;
+  size_t fl;
+  const size_t size = sizeof(buf)/sizeof(wchar_t);
+
+  if ( !PL_get_wchars(from, &fl, &f, CVT_ALL|CVT_EXCEPTION) )
+    return FALSE;
+
+  if ( (len=unaccentW(f, fl, buf, size)) <= (int)size )
+  { if ( len < 0 )			/* no change */
+      return PL_unify(to, from);
+    else
+      return PL_unify_wchars(to, PL_ATOM, len, buf);
+  } else
+  { wchar_t *t = PL_malloc((len+1)*sizeof(wchar_t));
+    int rc;
+
+    unaccentW(f, fl, t, len+1);
+    rc = PL_unify_wchars(to, PL_ATOM, len, t);
+    PL_free(t);
+    return rc;
+  }
+}
+
+
 static foreign_t
 pl_unaccent(term_t from, term_t to)
 { char buf[1024];
@@ -488,8 +998,10 @@ pl_unaccent(term_t from, term_t to)
   int len;
   size_t fl;
 
-  if ( !PL_get_nchars(from, &fl, &f, CVT_ALL|CVT_EXCEPTION) )
-    return FALSE;
+  if ( !PL_get_nchars(from, &fl, &f, CVT_ALL) )
+    return unaccent_wide(from, to);
+  if ( unaccent_skip(f, fl) == fl )	/* no accents: no copy */
+    return PL_unify(to, from);
 
   if ( (len=unaccent(f, fl, buf, sizeof(buf))) <= (int)sizeof(buf) )
   { if ( len < 0 )			/* no change */
@@ -512,156 +1024,164 @@ pl_unaccent(term_t from, term_t to)
 		 *	     TOKENISE		*
 		 *******************************/
 
-typedef enum
-{ TOK_INT,
-  TOK_FLOAT,
-  TOK_WORD,
-  TOK_PUNCT,
-  TOK_UNKNOWN
-} toktype;
-
-#undef isdigit
-#define issign(c) ((c) == '-' || (c) == '+' )
-#define isdigit(c) ((c) >= '0' && (c) <= '9')
-
-static int
-tokenizeA(const char *in, size_t len,
-	  int (*call)(const char *s,
-		      size_t len,
-		      toktype type,
-		      void *closure),
-	  void *closure)
-{ const unsigned char *s = (const unsigned char*)in;
-  const unsigned char *se = &s[len];
-  toktype type;
-
-  while(s<se)
-  { const unsigned char *st;		/* start token */
-
-    while(s<se && iswspace(*s))		/* skip blanks */
-      s++;
-    if ( s >= se )
-      break;
+#include "tokenize.ic"
 
-    st = s;
-    type = TOK_UNKNOWN;
 
-    if ( *s == '-' && se-s > 1 && isdigit(s[1]) )
-    { s += 2;
-      type = TOK_INT;
-    } else if ( isdigit(*s) )
-    { s++;
-      type = TOK_INT;
-    }
+typedef struct
+{ term_t head;
+  term_t tail;
+  term_t tmp;
+  int	 type;				/* PL_ATOM, PL_STRING, ... */
+  stopword_set *stop;			/* drop these words */
+} list;
 
-    if ( type == TOK_INT )
-    { while(s<se && isdigit(*s))
-	s++;
-      if ( s+2 <= se && *s == '.' && isdigit(s[1]) )
-      { s += 2;
-	type = TOK_FLOAT;
-	while(s<se && isdigit(*s))
-	  s++;
-      }
-      if ( s+2 <= se &&
-	   (*s == 'e' || *s == 'E') &&
-	   (isdigit(s[1]) || (s+3 <= se && issign(s[1]) && isdigit(s[2]))) )
-      { s += 2;
-	type = TOK_FLOAT;
-	while(s<se && isdigit(*s))
-	  s++;
-      }
 
-      if ( !(*call)((const char*)st, s-st, type, closure) )
-      { if ( PL_exception(0) )
-	  return FALSE;
-	while(s<se && iswalnum(*s))
-	  s++;
-	if ( !(*call)((const char*)st, s-st, TOK_WORD, closure) )
-	  return FALSE;
-      }
-    } else if ( iswalnum(*s) )
-    { while(s<se && iswalnum(*s))
-	s++;
-      if ( !(*call)((const char*)st, s-st, TOK_WORD, closure) )
-	return FALSE;
-    } else
-    { s++;
-      if ( !(*call)((const char*)st, 1, TOK_PUNCT, closure) )
-	return FALSE;
+/* Put the number token s into t.  Integers that fit in int64_t and
+   floats that neither overflow nor underflow are converted directly.
+   Other numbers are handed to the Prolog reader, which creates big
+   integers and implements the float_overflow and float_underflow
+   flags.  If the reader rejects the token we fail without an
+   exception and the tokenizer emits it as a word.
+*/
+
+static int
+put_number(term_t t, const char *s, size_t len, toktype type)
+{ if ( type == TOK_INT )
+  { const char *q = s, *e = &s[len];
+    int neg = (*q == '-');
+    uint64_t v = 0;
+
+    if ( neg )
+      q++;
+    for( ; q < e; q++)
+    { unsigned int d = *q - '0';
+
+      if ( v > (UINT64_MAX-d)/10 )
+	return PL_chars_to_term(s, t);
+      v = v*10 + d;
     }
+
+    if ( !neg && v <= (uint64_t)INT64_MAX )
+      return PL_put_int64(t, (int64_t)v);
+    if ( neg && v <= (uint64_t)INT64_MAX )
+      return PL_put_int64(t, -(int64_t)v);
+    if ( neg && v == (uint64_t)INT64_MAX+1 )
+      return PL_put_int64(t, INT64_MIN);
+  } else
+  { char *e;
+    double f;
+
+    errno = 0;
+    f = strtod(s, &e);			/* e != end: locale decimal point */
+    if ( e == &s[len] && errno != ERANGE )
+      return PL_put_float(t, f);
   }
 
-  return TRUE;
+  return PL_chars_to_term(s, t);
 }
 
 
+/* Put a number token, which is not 0-terminated, into t.  The token is
+   ISO Latin-1 text if wide is FALSE and wchar_t text otherwise.  Number
+   tokens only contain ASCII characters.
+*/
+
 static int
-tokenizeW(const wchar_t *in, size_t len,
-	  int (*call)(const wchar_t *s,
-		      size_t len,
-		      toktype type,
-		      void *closure),
-	 void *closure)
-{ const wchar_t *s = (const wchar_t*)in;
-  const wchar_t *se = &s[len];
-  toktype type;
+put_number_token(term_t t, const void *s, size_t len, int wide, toktype type)
+{ char buf[100];
+  char *a;
+  size_t i;
+  int rc;
+
+  if ( len+1 > sizeof(buf) )
+  { if ( !(a = malloc(len+1)) )
+      return PL_resource_error("memory");
+  } else
+  { a = buf;
+  }
+
+  for(i=0; i<len; i++)
+    a[i] = wide ? (char)((const wchar_t*)s)[i] : ((const char*)s)[i];
+  a[len] = '\0';
+
+  rc = put_number(t, a, len, type);
+  if ( a != buf )
+    free(a);
+
+  return rc;
+}
 
-  while(s<se)
-  { const wchar_t *st;			/* start token */
 
-    while(s<se && iswspace(*s))		/* skip blanks */
-      s++;
-    if ( s >= se )
+/* Lookup ISO Latin-1 text, which is UTF-8 if it is ASCII */
+
+static int
+stopword_lookupA(const stopword_set *set, const char *s, size_t len)
+{ char tmp[256];
+  char *u = tmp;
+  size_t i, o;
+  int rc;
+
+  for(i=0; i<len; i++)
+  { if ( s[i] & 0x80 )
       break;
+  }
+  if ( i == len )
+    return stopword_lookup(set, s, len);
 
-    st = s;
-    type = TOK_UNKNOWN;
+  if ( len*2 > sizeof(tmp) && !(u = malloc(len*2)) )
+    return FALSE;
+  for(i=0, o=0; i<len; i++)
+  { unsigned int c = s[i]&0xff;
 
-    if ( *s == '-' && se-s > 1 && isdigit(s[1]) )
-    { s += 2;
-      type = TOK_INT;
-    } else if ( isdigit(*s) )
-    { s++;
-      type = TOK_INT;
+    if ( c < 0x80 )
+    { u[o++] = c;
+    } else
+    { u[o++] = 0xc0|(c>>6);
+      u[o++] = 0x80|(c&0x3f);
     }
+  }
+  rc = stopword_lookup(set, u, o);
+  if ( u != tmp )
+    free(u);
 
-    if ( type == TOK_INT )
-    { while(s<se && isdigit(*s))
-	s++;
-      if ( s+2 <= se && *s == '.' && isdigit(s[1]) )
-      { s += 2;
-	type = TOK_FLOAT;
-	while(s<se && isdigit(*s))
-	  s++;
-      }
-      if ( s+2 <= se &&
-	   (*s == 'e' || *s == 'E') &&
-	   (isdigit(s[1]) || (s+3 <= se && issign(s[1]) && isdigit(s[2]))) )
-      { s += 2;
-	type = TOK_FLOAT;
-	while(s<se && isdigit(*s))
-	  s++;
-      }
+  return rc;
+}
 
-      if ( !(*call)((const wchar_t*)st, s-st, type, closure) )
-      { if ( PL_exception(0) )
-	  return FALSE;
-	while(s<se && iswalnum(*s))
-	  s++;
-	if ( !(*call)((const wchar_t*)st, s-st, TOK_WORD, closure) )
-	  return FALSE;
-      }
+static atom_t ATOM_stopwords;
+static atom_t ATOM_porter;
+static atom_t ATOM_none;
 
-    } else if ( iswalnum(*s) )
-    { while(s<se && iswalnum(*s))
-	s++;
-      if ( !(*call)((const wchar_t*)st, s-st, TOK_WORD, closure) )
-	return FALSE;
-    } else
-    { s++;
-      if ( !(*call)((const wchar_t*)st, 1, TOK_PUNCT, closure) )
+static void
+init_stopwords(void)
+{ ATOM_stopwords = PL_new_atom("stopwords");
+  ATOM_porter    = PL_new_atom("porter");
+  ATOM_none      = PL_new_atom("none");
+}
+
+/* Find stopwords(Set) in an option list.  Other options are ignored.
+   Sets *sp to NULL if there is no such option.  Sets of stems must
+   hold porter_stem/2 stems.
+*/
+
+static int
+get_stopword_option(term_t options, stopword_set **sp)
+{ term_t tail = PL_copy_term_ref(options);
+  term_t head = PL_new_term_ref();
+  term_t arg  = PL_new_term_ref();
+
+  *sp = NULL;
+  while( PL_get_list(tail, head, tail) )
+  { atom_t name;
+    size_t arity;
+
+    if ( PL_get_name_arity(head, &name, &arity) &&
+	 name == ATOM_stopwords && arity == 1 )
+    { PL_get_arg(1, head, arg);
+      if ( !get_stopword_set(arg, sp) )
 	return FALSE;
+      if ( (*sp)->stem && (*sp)->stem != ATOM_porter )
+	return PL_domain_error("stopword_set", arg);
+      return TRUE;
     }
   }
 
@@ -669,46 +1189,157 @@ tokenizeW(const wchar_t *in, size_t len,
 }
 
 
-typedef struct
-{ term_t head;
-  term_t tail;
-  term_t tmp;
-} list;
+/* Remove accents, downcase and stem the ISO Latin-1 word s as
+   atom_to_stem_list/2.  The result is in *bufp, which is tmp or a
+   PL_malloc()'ed buffer.  Returns the length of the stem.
+*/
+
+static int
+stem_token(const char *s, size_t len, char *tmp, size_t size, char **bufp)
+{ char *buf = tmp;
+  char *q;
+  int i, end, l;
+
+  l = abs(unaccent(s, len, buf, size));
+  if ( l > (int)size-1 )
+  { buf = PL_malloc(l+1);
+    unaccent(s, len, buf, l+1);
+  }
+  for(q=buf, i=0; i++ < l; q++)
+    *q = tolower(*q);
+
+  end = stem(buf, 0, l-1);
+  buf[++end] = '\0';
+  *bufp = buf;
+
+  return end;
+}
+
+
+/* Stop word tests for tokens.  Sets of words hold words normalized
+   according to set->flags.  Sets of stems hold the result of
+   porter_stem/2.
+*/
+
+static int
+is_stop_wordW(const stopword_set *set, const wchar_t *s, size_t len)
+{ wchar_t tmp[256];
+  char utmp[1024];
+  wchar_t *w = tmp;
+  char *u = utmp;
+  size_t i, o, n;
+  int rc;
+
+  if ( (n=normalize_text(s, len, set->flags, w, 256)) > 256 )
+  { w = PL_malloc(n*sizeof(wchar_t));
+    normalize_text(s, len, set->flags, w, n);
+  }
+  if ( n*4 > sizeof(utmp) )
+    u = PL_malloc(n*4);
+
+  for(i=0, o=0; i<n; i++)
+  { unsigned int c = (unsigned int)w[i];
+
+    if ( c < 0x80 )
+    { u[o++] = c;
+    } else if ( c < 0x800 )
+    { u[o++] = 0xc0|(c>>6);
+      u[o++] = 0x80|(c&0x3f);
+    } else if ( c < 0x10000 )
+    { u[o++] = 0xe0|(c>>12);
+      u[o++] = 0x80|((c>>6)&0x3f);
+      u[o++] = 0x80|(c&0x3f);
+    } else
+    { u[o++] = 0xf0|(c>>18);
+      u[o++] = 0x80|((c>>12)&0x3f);
+      u[o++] = 0x80|((c>>6)&0x3f);
+      u[o++] = 0x80|(c&0x3f);
+    }
+  }
+  rc = stopword_lookup(set, u, o);
+  if ( w != tmp )
+    PL_free(w);
+  if ( u != utmp )
+    PL_free(u);
+
+  return rc;
+}
+
+static int
+is_stop_wordA(const stopword_set *set, const char *s, size_t len)
+{ wchar_t tmp[256];
+  wchar_t *w = len > sizeof(tmp)/sizeof(wchar_t) ?
+			PL_malloc(len*sizeof(wchar_t)) : tmp;
+  size_t i;
+  int rc;
+
+  for(i=0; i<len; i++)
+    w[i] = s[i]&0xff;
+  rc = is_stop_wordW(set, w, len);
+  if ( w != tmp )
+    PL_free(w);
+
+  return rc;
+}
+
+static int
+is_stop_tokenA(const stopword_set *set, const char *s, size_t len)
+{ if ( set->stem )
+  { char tmp[1024];
+    char *buf;
+    int end = stem_token(s, len, tmp, sizeof(tmp), &buf);
+    int rc = stopword_lookupA(set, buf, end);
+
+    if ( buf != tmp )
+      PL_free(buf);
+    return rc;
+  }
+
+  return is_stop_wordA(set, s, len);
+}
+
+static int
+is_stop_tokenW(const stopword_set *set, const wchar_t *s, size_t len)
+{ if ( set->stem )
+  { char tmp[1024];
+    char *buf;
+    size_t nlen;
+
+    if ( (buf=unaccent_narrowW(s, len, tmp, sizeof(tmp), &nlen)) )
+    { int rc = is_stop_tokenA(set, buf, nlen);
+
+      if ( buf != tmp )
+	PL_free(buf);
+      return rc;
+    }
+  }
+
+  return is_stop_wordW(set, s, len);
+}
 
 
 static int
 unify_tokenA(const char *s, size_t len, toktype type, void *closure)
 { list *l = closure;
 
+  if ( type == TOK_WORD && l->stop && is_stop_tokenA(l->stop, s, len) )
+    return TRUE;
+
   switch(type)
   { case TOK_INT:
     case TOK_FLOAT:
-    { char buf[100];
-      char *a, *o;
-      const char *i;
-      int rc;
-
-      if ( len+1 > sizeof(buf) )
-      { if ( !(a = malloc(len+1)) )
-	  return PL_resource_error("memory");
-      } else
-      { a = buf;
-      }
-
-      for(i=s,o=a; len-- > 0; )
-	*o++ = (char)*i++;
-      *o = '\0';
-
-      rc = PL_chars_to_term(a, l->tmp);
-      if ( a != buf )
-	free(a);
-      if ( !rc )
-	return rc;
+      if ( !put_number_token(l->tmp, s, len, FALSE, type) )
+	return FALSE;
       break;
-    }
     default:
-      if ( !PL_put_atom_nchars(l->tmp, len, s) )
-	return FALSE;
+      if ( l->type == PL_ATOM )
+      { if ( !PL_put_atom_nchars(l->tmp, len, s) )
+	  return FALSE;
+      } else
+      { if ( !PL_put_variable(l->tmp) ||
+	     !PL_unify_chars(l->tmp, l->type, len, s) )
+	  return FALSE;
+      }
     break;
   }
 
@@ -721,36 +1352,18 @@ static int
 unify_tokenW(const wchar_t *s, size_t len, toktype type, void *closure)
 { list *l = closure;
 
+  if ( type == TOK_WORD && l->stop && is_stop_tokenW(l->stop, s, len) )
+    return TRUE;
+
   switch(type)
   { case TOK_INT:
     case TOK_FLOAT:
-    { char buf[100];
-      char *a, *o;
-      const wchar_t *i;
-      int rc;
-
-      if ( len+1 > sizeof(buf) )
-      { if ( !(a = malloc(len+1)) )
-	  return PL_resource_error("memory");
-      } else
-      { a = buf;
-      }
-
-      for(i=s,o=a; len-- > 0; )
-	*o++ = (char)*i++;
-      *o = '\0';
-
-      rc = PL_chars_to_term(a, l->tmp);
-
-      if ( a != buf )
-	free(a);
-      if ( !rc )
-	return rc;
+      if ( !put_number_token(l->tmp, s, len, TRUE, type) )
+	return FALSE;
       break;
-    }
     default:
       if ( !PL_put_variable(l->tmp) ||
-	   !PL_unify_wchars(l->tmp, PL_ATOM, len, s) )
+	   !PL_unify_wchars(l->tmp, l->type, len, s) )
 	return FALSE;
       break;
   }
@@ -761,8 +1374,8 @@ unify_tokenW(const wchar_t *s, size_t len, toktype type, void *closure)
 
 
 
-static foreign_t
-pl_tokenize(term_t text, term_t tokens)
+static int
+tokenize(term_t text, term_t tokens, int type, stopword_set *stop)
 { char *s;
   wchar_t *ws;
   size_t len;
@@ -771,6 +1384,8 @@ pl_tokenize(term_t text, term_t tokens)
   l.tail = PL_copy_term_ref(tokens);
   l.head = PL_new_term_ref();
   l.tmp  = PL_new_term_ref();
+  l.type = type;
+  l.stop = stop;
 
   if ( PL_get_nchars(text, &len, &s, CVT_ALL) )
   { if ( !tokenizeA(s, len, unify_tokenA, &l) )
@@ -785,6 +1400,216 @@ pl_tokenize(term_t text, term_t tokens)
 }
 
 
+static foreign_t
+pl_tokenize(term_t text, term_t tokens)
+{ return tokenize(text, tokens, PL_ATOM, NULL);
+}
+
+
+static foreign_t
+pl_tokenize3(term_t text, term_t tokens, term_t options)
+{ int type;
+  stopword_set *stop;
+
+  return ( get_text_type(options, &type) &&
+	   get_stopword_option(options, &stop) &&
+	   tokenize(text, tokens, type, stop) );
+}
+
+
+/* tokenize_spans/2 creates Type-Start-Length terms for each token.  The
+   only atoms used are the token types.  Number tokens are converted to
+   find out whether they are numbers for tokenize_atom/2.
+*/
+
+typedef struct
+{ list		list;
+  const void   *base;			/* start of the text */
+  size_t	unit;			/* sizeof(char) or sizeof(wchar_t) */
+} span_list;
+
+static atom_t ATOM_integer;
+static atom_t ATOM_float;
+static atom_t ATOM_word;
+static atom_t ATOM_punct;
+static functor_t FUNCTOR_minus2;
+
+static int
+unify_span(span_list *sl, const void *s, size_t len, toktype type)
+{ list *l = &sl->list;
+  atom_t a;
+  int64_t start = ((const char*)s - (const char*)sl->base)/sl->unit;
+
+  switch(type)
+  { case TOK_INT:   a = ATOM_integer; break;
+    case TOK_FLOAT: a = ATOM_float;   break;
+    case TOK_WORD:  a = ATOM_word;    break;
+    default:	    a = ATOM_punct;   break;
+  }
+
+  return ( PL_unify_list(l->tail, l->head, l->tail) &&
+	   PL_unify_term(l->head,
+			 PL_FUNCTOR, FUNCTOR_minus2,
+			   PL_FUNCTOR, FUNCTOR_minus2,
+			     PL_ATOM, a,
+			     PL_INT64, start,
+			   PL_INT64, (int64_t)len) );
+}
+
+static int
+unify_spanA(const char *s, size_t len, toktype type, void *closure)
+{ span_list *sl = closure;
+
+  if ( (type == TOK_INT || type == TOK_FLOAT) &&
+       !put_number_token(sl->list.tmp, s, len, FALSE, type) )
+    return FALSE;
+
+  return unify_span(sl, s, len, type);
+}
+
+static int
+unify_spanW(const wchar_t *s, size_t len, toktype type, void *closure)
+{ span_list *sl = closure;
+
+  if ( (type == TOK_INT || type == TOK_FLOAT) &&
+       !put_number_token(sl->list.tmp, s, len, TRUE, type) )
+    return FALSE;
+
+  return unify_span(sl, s, len, type);
+}
+
+
+static foreign_t
+pl_tokenize_spans(term_t text, term_t spans)
+{ char *s;
+  wchar_t *ws;
+  size_t len;
+  span_list sl;
+
+  sl.list.tail = PL_copy_term_ref(spans);
+  sl.list.head = PL_new_term_ref();
+  sl.list.tmp  = PL_new_term_ref();
+  sl.list.type = PL_ATOM;
+  sl.list.stop = NULL;
+
+  if ( PL_get_nchars(text, &len, &s, CVT_ALL) )
+  { sl.base = s;
+    sl.unit = sizeof(char);
+    if ( !tokenizeA(s, len, unify_spanA, &sl) )
+      return FALSE;
+  } else if ( PL_get_wchars(text, &len, &ws, CVT_ALL|CVT_EXCEPTION) )
+  { sl.base = ws;
+    sl.unit = sizeof(wchar_t);
+    if ( !tokenizeW(ws, len, unify_spanW, &sl) )
+      return FALSE;
+  } else
+    return FALSE;
+
+  return PL_unify_nil(sl.list.tail);
+}
+
+
+/* Read the next chunk from a stream and add its tokens to the difference
+   list Tokens\Tail.  A chunk holds at least TOKEN_CHUNK characters and
+   ends at a blank, after a punctuation character that cannot be part of
+   a number or at the end of the input.  As tokens never contain blanks
+   and such a punctuation character is always a token by itself, this
+   produces the same tokens as tokenizing the whole input.  The size of
+   a chunk is thus bounded by TOKEN_CHUNK plus the longest sequence of
+   letters, digits and number punctuation.  Leading blanks are skipped,
+   so a chunk holds at least one token unless we are at the end of the
+   input, in which case Tail is [].
+*/
+
+#define TOKEN_CHUNK 4096
+
+#define ischunkend(c) \
+	( !isalnumW(c) && (c) != '-' && (c) != '+' && (c) != '.' )
+
+static foreign_t
+pl_tokenize_stream_chunk(term_t stream, term_t tokens, term_t tail)
+{ IOSTREAM *in;
+  wchar_t fast[2*TOKEN_CHUNK];
+  wchar_t *buf = fast;
+  size_t size = 2*TOKEN_CHUNK;
+  size_t len = 0;
+  int c;
+  int rc;
+  list l;
+
+  if ( !PL_get_stream(stream, &in, SIO_INPUT) )
+    return FALSE;
+
+  for(;;)
+  { if ( (c=Sgetcode(in)) == -1 )
+      break;
+    if ( isspaceW(c) )
+    { if ( len == 0 )
+	continue;
+      if ( len >= TOKEN_CHUNK )
+	break;
+    }
+    if ( len == size )
+    { wchar_t *new;
+
+      if ( buf == fast )
+      { if ( (new = PL_malloc(size*2*sizeof(wchar_t))) )
+	  memcpy(new, buf, len*sizeof(wchar_t));
+      } else
+      { new = PL_realloc(buf, size*2*sizeof(wchar_t));
+      }
+      if ( !new )
+      { rc = PL_resource_error("memory");
+	goto out;
+      }
+      buf = new;
+      size *= 2;
+    }
+    buf[len++] = (wchar_t)c;
+    if ( len >= TOKEN_CHUNK && ischunkend(c) )
+      break;
+  }
+
+  l.tail = PL_copy_term_ref(tokens);
+  l.head = PL_new_term_ref();
+  l.tmp  = PL_new_term_ref();
+  l.type = PL_ATOM;
+  l.stop = NULL;
+
+  rc = ( tokenizeW(buf, len, unify_tokenW, &l) &&
+	 PL_unify(l.tail, tail) &&
+	 (c != -1 || PL_unify_nil(tail)) );
+
+out:
+  if ( buf != fast )
+    PL_free(buf);
+  if ( !PL_release_stream(in) )
+    rc = FALSE;
+
+  return rc;
+}
+
+
+static int
+unify_stem_token(const char *s, size_t len, list *list)
+{ char tmp[1024];
+  char *buf;
+  int rc, end;
+
+  end = stem_token(s, len, tmp, sizeof(tmp), &buf);
+  if ( list->stop && list->stop->stem &&
+       stopword_lookupA(list->stop, buf, end) )
+    rc = TRUE;
+  else
+    rc = ( PL_unify_list(list->tail, list->head, list->tail) &&
+	   PL_unify_chars(list->head, list->type, end, buf) );
+  if ( buf != tmp )
+    PL_free(buf);
+
+  return rc;
+}
+
+
 static int
 unify_stem(const char *s, size_t len, toktype type, void *closure)
 { list *list = closure;
@@ -794,58 +1619,170 @@ unify_stem(const char *s, size_t len, toktype type, void *closure)
   if ( type == TOK_INT || type == TOK_FLOAT )
     return unify_tokenA(s, len, type, closure);
 
-  if ( PL_unify_list(list->tail, list->head, list->tail) )
-  { char tmp[1024];
-    char *buf = tmp;
-    char *q;
-    int i, rc, end, l;
-
-					/* unaccent */
-    l = abs(unaccent(s, len, buf, sizeof(tmp)));
-    if ( l > (int)sizeof(buf) )
-    { buf = PL_malloc(l+1);
-      unaccent(s, len, buf, l+1);
-    }
+  if ( list->stop && !list->stop->stem &&
+       is_stop_wordA(list->stop, s, len) )
+    return TRUE;
 
-					/* downcase */
-    for(q=buf, i=0; i++ < l; q++)
-      *q = tolower(*q);
+  return unify_stem_token(s, len, list);
+}
 
-    end = stem(buf, 0, l-1);
-    buf[++end] = '\0';
 
-    rc = PL_unify_atom_nchars(list->head, end, buf);
-    if ( buf != tmp )
-      PL_free(buf);
 
-    return rc;
-  }
+/* Stem a token from wide text.  Tokens that fit ISO Latin-1 after
+   removing accents are handled by unify_stem(), such that the result
+   does not depend on whether the text is wide.  Other tokens are
+   downcased.
+*/
 
-  return FALSE;
-}
+static int
+unify_stemW(const wchar_t *s, size_t len, toktype type, void *closure)
+{ list *list = closure;
+  char tmp[1024];
+  char *buf;
+  size_t nlen;
+  int rc;
 
+  if ( type == TOK_PUNCT )
+    return TRUE;
+  if ( type == TOK_INT || type == TOK_FLOAT )
+    return unify_tokenW(s, len, type, closure);
+
+  if ( list->stop && is_stop_tokenW(list->stop, s, len) )
+    return TRUE;
+  if ( !(buf=unaccent_narrowW(s, len, tmp, sizeof(tmp), &nlen)) )
+    return ( PL_unify_list(list->tail, list->head, list->tail) &&
+	     unify_downcaseW(list->head, s, len, list->type) );
 
+  rc = unify_stem_token(buf, nlen, list);
+  if ( buf != tmp )
+    PL_free(buf);
 
-static foreign_t
-pl_atom_to_stem_list(term_t text, term_t stems)
+  return rc;
+}
+
+
+static int
+atom_to_stem_list(term_t text, term_t stems, int type, stopword_set *stop)
 { char *s;
+  wchar_t *ws;
   size_t len;
   list l;
 
-  if ( !PL_get_nchars(text, &len, &s, CVT_ALL) )
-    return FALSE;
-
   l.tail = PL_copy_term_ref(stems);
   l.head = PL_new_term_ref();
   l.tmp  = PL_new_term_ref();
+  l.type = type;
+  l.stop = stop;
 
-  if ( !tokenizeA(s, len, unify_stem, &l) )
+  if ( PL_get_nchars(text, &len, &s, CVT_ALL) )
+  { if ( !tokenizeA(s, len, unify_stem, &l) )
+      return FALSE;
+  } else if ( PL_get_wchars(text, &len, &ws, CVT_ALL|CVT_EXCEPTION) )
+  { if ( !tokenizeW(ws, len, unify_stemW, &l) )
+      return FALSE;
+  } else
     return FALSE;
 
   return PL_unify_nil(l.tail);
 }
 
 
+static foreign_t
+pl_atom_to_stem_list(term_t text, term_t stems)
+{ return atom_to_stem_list(text, stems, PL_ATOM, NULL);
+}
+
+
+static foreign_t
+pl_atom_to_stem_list3(term_t text, term_t stems, term_t options)
+{ int type;
+  stopword_set *stop;
+
+  return ( get_text_type(options, &type) &&
+	   get_stopword_option(options, &stop) &&
+	   atom_to_stem_list(text, stems, type, stop) );
+}
+
+
+/* $stopword_normalize(+Word, +Flags, -Key) normalizes Word according
+   to the NORM_* Flags as nlp_analyze/3.
+*/
+
+static foreign_t
+pl_stopword_normalize(term_t t_word, term_t t_flags, term_t t_key)
+{ wchar_t tmp[256];
+  wchar_t *s, *w = tmp;
+  size_t len, n;
+  int flags, rc;
+
+  if ( !PL_get_wchars(t_word, &len, &s,
+		      CVT_ATOM|CVT_STRING|CVT_LIST|CVT_EXCEPTION) ||
+       !PL_get_integer_ex(t_flags, &flags) )
+    return FALSE;
+
+  if ( (n=normalize_text(s, len, flags, w, 256)) > 256 )
+  { w = PL_malloc(n*sizeof(wchar_t));
+    normalize_text(s, len, flags, w, n);
+  }
+  rc = PL_unify_wchars(t_key, PL_ATOM, n, w);
+  if ( w != tmp )
+    PL_free(w);
+
+  return rc;
+}
+
+
+/* $stopword_set_create(+Words, +Stem, +Flags, -Set) creates a
+   stopword_set blob from a list of words.  The words are normalized
+   according to Flags and stemmed using Stem by the Prolog caller.
+*/
+
+static foreign_t
+pl_stopword_set_create(term_t words, term_t t_stem, term_t t_flags,
+		       term_t t_set)
+{ term_t tail = PL_copy_term_ref(words);
+  term_t head = PL_new_term_ref();
+  stopword *w;
+  stopword_set *set = NULL;
+  size_t n, i = 0, k;
+  atom_t stem;
+  int flags, rc = FALSE;
+
+  if ( !PL_get_atom_ex(t_stem, &stem) ||
+       !PL_get_integer_ex(t_flags, &flags) )
+    return FALSE;
+  if ( stem == ATOM_none )
+    stem = 0;
+  if ( PL_skip_list(words, 0, &n) != PL_LIST )
+    return PL_type_error("list", words);
+  if ( !(w = calloc(n+1, sizeof(*w))) )
+    return PL_resource_error("memory");
+
+  for( ; PL_get_list(tail, head, tail); i++)
+  { char *s;
+
+    if ( !PL_get_nchars(head, &w[i].len, &s,
+			CVT_ATOM|CVT_STRING|CVT_LIST|REP_UTF8|
+			BUF_MALLOC|CVT_EXCEPTION) )
+      goto out;
+    w[i].s = s;
+  }
+
+  if ( !(set = build_stopword_set(w, n, flags, stem)) )
+    rc = PL_resource_error("memory");
+  else if ( !(rc = PL_unify_blob(t_set, &set, sizeof(set),
+				 &stopword_set_blob)) )
+    free_stopword_set(set);
+
+out:
+  for(k=0; k<n; k++)
+    PL_free((char*)w[k].s);
+  free(w);
+
+  return rc;
+}
+
+
 
 
 		 /*******************************
@@ -854,10 +1791,33 @@ pl_atom_to_stem_list(term_t text, term_t stems)
 
 install_t
 install_porter_stem()
-{ PL_register_foreign("porter_stem",       2, pl_stem,     0);
+{ ATOM_integer   = PL_new_atom("integer");
+  ATOM_float     = PL_new_atom("float");
+  ATOM_word      = PL_new_atom("word");
+  ATOM_punct     = PL_new_atom("punct");
+  FUNCTOR_minus2 = PL_new_functor(PL_new_atom("-"), 2);
+  init_text_type();
+  init_stopwords();
+
+  PL_register_foreign("porter_stem",       2, pl_stem,     0);
+  PL_register_foreign("porter_stem",       3, pl_stem3,    0);
+  PL_register_foreign("porter_stem_list",  2, pl_stem_list, 0);
+  PL_register_foreign("set_porter_stem_cache_size", 1,
+		      pl_set_stem_cache_size, 0);
+  PL_register_foreign("porter_stem_cache_clear", 0, pl_stem_cache_clear, 0);
+  PL_register_foreign("$porter_stem_cache_statistics", 1,
+		      pl_stem_cache_stats, 0);
   PL_register_foreign("unaccent_atom",	   2, pl_unaccent, 0);
   PL_register_foreign("tokenize_atom",	   2, pl_tokenize, 0);
+  PL_register_foreign("tokenize_atom",	   3, pl_tokenize3, 0);
+  PL_register_foreign("tokenize_spans",	   2, pl_tokenize_spans, 0);
+  PL_register_foreign("$tokenize_stream_chunk", 3,
+		      pl_tokenize_stream_chunk, 0);
   PL_register_foreign("atom_to_stem_list", 2, pl_atom_to_stem_list, 0);
+  PL_register_foreign("atom_to_stem_list", 3, pl_atom_to_stem_list3, 0);
+  PL_register_foreign("$stopword_normalize", 3, pl_stopword_normalize, 0);
+  PL_register_foreign("$stopword_set_create", 4, pl_stopword_set_create, 0);
+  PL_thread_at_exit(stem_destroy_memo, NULL, TRUE);
 }
 
 
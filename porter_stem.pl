@@ -34,17 +34,106 @@
 
 :- module(porter_stem,
           [ porter_stem/2,              % +Raw, -Stem
+            porter_stem/3,              % +Raw, -Stem, +Options
+            porter_stem_list/2,         % +Words, -Stems
             unaccent_atom/2,            % +Raw, -Unaccented
             tokenize_atom/2,            % +Raw, -Tokens
-            atom_to_stem_list/2         % +Raw, -ListOfStems
+            tokenize_atom/3,            % +Raw, -Tokens, +Options
+            tokenize_spans/2,           % +Raw, -Spans
+            tokenize_stream/2,          % +Stream, :OnToken
+            tokenize_stream_lazy/2,     % +Stream, -Tokens
+            atom_to_stem_list/2,        % +Raw, -ListOfStems
+            atom_to_stem_list/3,        % +Raw, -ListOfStems, +Options
+            set_porter_stem_cache_size/1, % +Size
+            porter_stem_cache_clear/0,
+            porter_stem_cache_property/1, % ?Property
+            stopword_set_create/3       % +Words, -Set, +Options
           ]).
-
+:- autoload(library(lists), [member/2]).
+:- autoload(library(lazy_lists), [lazy_list/2]).
+:- autoload(library(apply), [maplist/3]).
+:- autoload(library(option), [option/3]).
+:- autoload(library(error), [must_be/2]).
+:- autoload(library(snowball), [snowball/3]).
 
 :- use_foreign_library(foreign(porter_stem)).
 
+:- meta_predicate
+    tokenize_stream(+, 1).
+
+tokenize_stream(Stream, OnToken) :-
+    '$tokenize_stream_chunk'(Stream, Tokens, Tail),
+    call_tokens(Tokens, Tail, OnToken),
+    (   Tail == []
+    ->  true
+    ;   tokenize_stream(Stream, OnToken)
+    ).
+
+call_tokens(Tokens, Tail, _) :-
+    Tokens == Tail,
+    !.
+call_tokens([H|T], Tail, OnToken) :-
+    once(call(OnToken, H)),
+    call_tokens(T, Tail, OnToken).
+
+tokenize_stream_lazy(Stream, Tokens) :-
+    lazy_list('$tokenize_stream_chunk'(Stream), Tokens).
+
+stopword_set_create(Words, Set, Options) :-
+    option(stem(Stem), Options, none),
+    stopword_flags(Stem, Options, Flags),
+    maplist(stopword_key(Stem, Flags), Words, Keys),
+    '$stopword_set_create'(Keys, Stem, Flags, Set).
+
+%   The flags match the normalization flags of nlp_pipeline_create/2.
+%   porter_stem/2 removes accents and maps to lower case.
+
+stopword_flags(porter, _, 0x3) :-
+    !.
+stopword_flags(_, Options, Flags) :-
+    option(casefold(CaseFold), Options, true),
+    option(unaccent(UnAccent), Options, false),
+    bool_flag(CaseFold, 0x1, F1),
+    bool_flag(UnAccent, 0x2, F2),
+    Flags is F1\/F2.
+
+bool_flag(true,  Flag, Flag) :- !.
+bool_flag(false, _,    0) :- !.
+bool_flag(Value, _,    _) :-
+    must_be(boolean, Value).
+
+stopword_key(none, Flags, Word, Key) :-
+    !,
+    '$stopword_normalize'(Word, Flags, Key).
+stopword_key(porter, _, Word, Key) :-
+    !,
+    porter_stem(Word, Key).
+stopword_key(Algorithm, Flags, Word, Key) :-
+    '$stopword_normalize'(Word, Flags, Normalized),
+    snowball(Algorithm, Normalized, Key).
+
+porter_stem_cache_property(Property) :-
+    '$porter_stem_cache_statistics'(
+        porter_stem_cache(Size, Count, Hits, Misses, Evictions)),
+    member(Property,
+           [ size(Size), count(Count), hits(Hits), misses(Misses),
+             evictions(Evictions)
+           ]).
+
 :- multifile sandbox:safe_primitive/1.
 
 sandbox:safe_primitive(porter_stem:porter_stem(_,_)).
+sandbox:safe_primitive(porter_stem:porter_stem(_,_,_)).
+sandbox:safe_primitive(porter_stem:porter_stem_list(_,_)).
 sandbox:safe_primitive(porter_stem:unaccent_atom(_,_)).
 sandbox:safe_primitive(porter_stem:tokenize_atom(_,_)).
+sandbox:safe_primitive(porter_stem:tokenize_atom(_,_,_)).
+sandbox:safe_primitive(porter_stem:tokenize_spans(_,_)).
+sandbox:safe_primitive(porter_stem:'$tokenize_stream_chunk'(_,_,_)).
 sandbox:safe_primitive(porter_stem:atom_to_stem_list(_,_)).
+sandbox:safe_primitive(porter_stem:atom_to_stem_list(_,_,_)).
+sandbox:safe_primitive(porter_stem:porter_stem_cache_clear).
+sandbox:safe_primitive(porter_stem:'$porter_stem_cache_statistics'(_)).
+sandbox:safe_primitive(porter_stem:'$stopword_normalize'(_,_,_)).
+sandbox:safe_primitive(porter_stem:'$stopword_set_create'(_,_,_,_)).
+
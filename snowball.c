@@ -38,7 +38,11 @@
 #include <SWI-Stream.h>
 #include "libstemmer_c/include/libstemmer.h"
 #include <pthread.h>
+#include <stdatomic.h>
+#include <stdlib.h>
 #include <string.h>
+#include <wchar.h>
+#include <wctype.h>
 #include <assert.h>
 #include <errno.h>
 
@@ -46,6 +50,10 @@
 #define __thread __declspec(thread)
 #endif
 
+#include "text_type.ic"
+
+static atom_t ATOM_none;
+
 #define STEMMER_BUCKETS (32)		/* cache CACHE_SIZE languages */
 
 typedef struct stemmer
@@ -60,6 +68,137 @@ typedef struct
 
 static __thread stem_cache *cache_ptr = NULL;
 
+#define ATOM_HASH(a) ((unsigned int)(a>>7) & (STEMMER_BUCKETS-1))
+
+
+		 /*******************************
+		 *	   STEMMER POOL		*
+		 *******************************/
+
+/* Creating a stemmer is expensive compared to stemming a word.  Threads
+   that terminate therefore return their stemmers to a process-wide pool
+   from which new threads borrow them.  The pool has a fixed array of
+   slots per language.  A stemmer is borrowed by atomically exchanging a
+   slot with NULL and returned by a compare-and-swap of an empty slot,
+   which avoids locks as well as the ABA problem of a lock-free stack.
+   Languages are added by pushing on a bucket chain and never removed.
+*/
+
+#define POOL_MAX_SIZE	  64		/* max slots per language */
+#define POOL_DEFAULT_SIZE 8
+
+typedef struct pool_lang
+{ atom_t		language;
+  struct pool_lang     *next;
+  atomic_bool		cached;		/* use the shared result cache */
+  _Atomic(struct sb_stemmer*) slots[POOL_MAX_SIZE];
+} pool_lang;
+
+static _Atomic(pool_lang*) pool[STEMMER_BUCKETS];
+static atomic_int  pool_size = POOL_DEFAULT_SIZE;
+static atomic_long stemmers_created;	/* sb_stemmer_new() calls */
+static atomic_long stemmers_deleted;	/* sb_stemmer_delete() calls */
+static atomic_long stemmers_pooled;	/* # stemmers in the pool */
+static atomic_long stemmers_reused;	/* # borrowed from the pool */
+
+static pool_lang *
+lookup_pool_lang(atom_t lang, bool create)
+{ _Atomic(pool_lang*) *bucket = &pool[ATOM_HASH(lang)];
+  pool_lang *head = atomic_load(bucket);
+  pool_lang *pl = NULL;
+
+  for(;;)
+  { pool_lang *p;
+
+    for(p=head; p; p=p->next)
+    { if ( p->language == lang )
+      { if ( pl )			/* lost the race */
+	{ PL_unregister_atom(pl->language);
+	  PL_free(pl);
+	}
+	return p;
+      }
+    }
+    if ( !create )
+      return NULL;
+    if ( !pl )
+    { if ( !(pl = PL_malloc(sizeof(*pl))) )
+	return NULL;
+      memset(pl, 0, sizeof(*pl));
+      pl->language = lang;
+      PL_register_atom(lang);
+    }
+    pl->next = head;
+    if ( atomic_compare_exchange_strong(bucket, &head, pl) )
+      return pl;
+  }
+}
+
+static struct sb_stemmer *
+new_stemmer(atom_t lang)
+{ const char *lname;
+  struct sb_stemmer *st;
+
+  if ( (lname=PL_atom_chars(lang)) &&
+       (st=sb_stemmer_new(lname, NULL)) )
+  { atomic_fetch_add(&stemmers_created, 1);
+    return st;
+  }
+
+  return NULL;
+}
+
+static void
+delete_stemmer(struct sb_stemmer *st)
+{ sb_stemmer_delete(st);
+  atomic_fetch_add(&stemmers_deleted, 1);
+}
+
+static struct sb_stemmer *
+borrow_stemmer(atom_t lang)
+{ pool_lang *pl;
+
+  if ( (pl=lookup_pool_lang(lang, false)) )
+  { for(int i=0; i<POOL_MAX_SIZE; i++)
+    { struct sb_stemmer *st;
+
+      if ( atomic_load(&pl->slots[i]) &&
+	   (st=atomic_exchange(&pl->slots[i], NULL)) )
+      { atomic_fetch_sub(&stemmers_pooled, 1);
+	atomic_fetch_add(&stemmers_reused, 1);
+	return st;
+      }
+    }
+  }
+
+  return NULL;
+}
+
+/* Return a stemmer to the pool.  If the pool for this language is full
+   the stemmer is deleted and false is returned.
+*/
+
+static bool
+return_stemmer(atom_t lang, struct sb_stemmer *st)
+{ int size = atomic_load(&pool_size);
+  pool_lang *pl;
+
+  if ( size > 0 && (pl=lookup_pool_lang(lang, true)) )
+  { for(int i=0; i<size; i++)
+    { struct sb_stemmer *empty = NULL;
+
+      if ( atomic_compare_exchange_strong(&pl->slots[i], &empty, st) )
+      { atomic_fetch_add(&stemmers_pooled, 1);
+	return true;
+      }
+    }
+  }
+
+  delete_stemmer(st);
+  return false;
+}
+
+
 static void
 stem_destroy_cache(void *buf)
 { stem_cache *cache = cache_ptr;
@@ -72,8 +211,8 @@ stem_destroy_cache(void *buf)
       for( ; s; s = n)
       { n = s->next;
 
+	return_stemmer(s->language, s->stemmer);
 	PL_unregister_atom(s->language);
-	sb_stemmer_delete(s->stemmer);
 	PL_free(s);
       }
     }
@@ -97,8 +236,6 @@ get_cache(void)
 }
 
 
-#define ATOM_HASH(a) ((unsigned int)(a>>7) & (STEMMER_BUCKETS-1))
-
 static bool
 get_lang_stemmer(term_t t, struct sb_stemmer **stemmerp)
 { stem_cache *cache = get_cache();
@@ -106,7 +243,6 @@ get_lang_stemmer(term_t t, struct sb_stemmer **stemmerp)
   int k;
   stemmer *s;
   struct sb_stemmer *st;
-  const char *lname;
 
   if ( !PL_get_atom(t, &lang) )
     return PL_type_error("atom", t);
@@ -119,8 +255,8 @@ get_lang_stemmer(term_t t, struct sb_stemmer **stemmerp)
     }
   }
 
-  if ( !(lname=PL_atom_chars(lang)) ||
-       !(st=sb_stemmer_new(lname, NULL)) )
+  if ( !(st=borrow_stemmer(lang)) &&
+       !(st=new_stemmer(lang)) )
   { if ( errno == ENOMEM )
       return PL_resource_error("memory");
     else
@@ -140,24 +276,500 @@ get_lang_stemmer(term_t t, struct sb_stemmer **stemmerp)
 }
 
 
-static foreign_t
-snowball(term_t lang, term_t in, term_t out)
+		 /*******************************
+		 *	 SHARED RESULT CACHE	*
+		 *******************************/
+
+/* Optional process-wide cache from (language, word) to stem, enabled
+   per language using set_snowball_cache/2.  The cache is a set
+   associative table.  Each set is protected by a sequence lock: writers
+   make the sequence number odd while updating the entries.  Readers do
+   not modify the entries; they only set the CLOCK reference bit of the
+   entry they hit.  Neither side waits: a reader that finds the sequence
+   number odd or changed while reading treats the lookup as a miss and a
+   writer that finds the set locked does not add its result.  An entry
+   is 64 bytes of atomic words that hold the language, the hash, the
+   lengths and the UTF-8 bytes of the word followed by its stem, so
+   readers never follow pointers into memory that may be freed.  Words
+   whose word and stem do not fit in CACHE_TEXT_BYTES are not cached.
+   Entries are replaced using the CLOCK algorithm within a set.
+
+   The table is allocated when the first language is enabled and
+   cannot be resized after that because readers may still access it.
+*/
+
+#define CACHE_WAYS	  8		/* entries per set */
+#define CACHE_WORDS	  8		/* 64-bit words per entry */
+#define CACHE_TEXT_BYTES  ((CACHE_WORDS-2)*8)
+#define CACHE_STRIPES	  16		/* counter stripes */
+#define CACHE_DEFAULT_SIZE 65536	/* entries */
+
+typedef struct cache_entry
+{ _Atomic uint64_t	w[CACHE_WORDS];	/* lang, hash+lengths, text */
+} cache_entry;
+
+typedef struct cache_set
+{ atomic_uint		seq;		/* sequence lock */
+  unsigned int		hand;		/* CLOCK hand */
+  atomic_uchar		referenced[CACHE_WAYS];
+  cache_entry		entries[CACHE_WAYS];
+} cache_set;
+
+typedef struct cache_counters
+{ atomic_long		hits;
+  atomic_long		misses;
+  atomic_long		evictions;
+  char			pad[64-3*sizeof(atomic_long)];
+} cache_counters;
+
+static _Atomic(cache_set*) cache_sets;
+static size_t		   cache_nsets;
+static size_t		   cache_size = CACHE_DEFAULT_SIZE;
+static atomic_int	   cached_languages;
+static cache_counters	   cache_stats[CACHE_STRIPES];
+
+static uint64_t
+cache_hash(atom_t lang, const char *s, size_t len)
+{ uint64_t h = 0xcbf29ce484222325ULL ^ (uint64_t)lang;
+
+  while(len-- > 0)
+  { h ^= (unsigned char)*s++;
+    h *= 0x100000001b3ULL;
+  }
+
+  return h ^ (h>>29);
+}
+
+static bool
+cache_write_lock(cache_set *set, unsigned int *seqp)
+{ unsigned int seq = atomic_load_explicit(&set->seq, memory_order_relaxed);
+
+  if ( (seq&1) ||
+       !atomic_compare_exchange_strong_explicit(&set->seq, &seq, seq+1,
+						memory_order_acquire,
+						memory_order_relaxed) )
+    return false;
+  atomic_thread_fence(memory_order_release);
+  *seqp = seq;
+
+  return true;
+}
+
+static void
+cache_write_unlock(cache_set *set, unsigned int seq)
+{ atomic_store_explicit(&set->seq, seq+2, memory_order_release);
+}
+
+/* Read the text of entry e into buf and return whether it holds the
+   given key.  The caller validates the result using the sequence lock.
+*/
+
+static bool
+cache_read_entry(cache_entry *e, atom_t lang, uint32_t hash,
+		 const char *key, size_t klen, char *buf, size_t *vlenp)
+{ uint64_t w0 = atomic_load_explicit(&e->w[0], memory_order_relaxed);
+  uint64_t w1, text[CACHE_WORDS-2];
+  size_t vlen, nw;
+
+  if ( w0 != (uint64_t)lang )
+    return false;
+  w1 = atomic_load_explicit(&e->w[1], memory_order_relaxed);
+  if ( (uint32_t)w1 != hash || ((w1>>32)&0xff) != klen )
+    return false;
+  vlen = (size_t)(w1>>40)&0xff;
+  if ( klen+vlen > CACHE_TEXT_BYTES )
+    return false;			/* torn read */
+
+  nw = (klen+vlen+7)/8;
+  for(size_t i=0; i<nw; i++)
+    text[i] = atomic_load_explicit(&e->w[i+2], memory_order_relaxed);
+  if ( memcmp(text, key, klen) != 0 )
+    return false;
+  memcpy(buf, (char*)text+klen, vlen);
+  *vlenp = vlen;
+
+  return true;
+}
+
+static bool
+cache_lookup(atom_t lang, const char *key, size_t klen,
+	     char *buf, size_t *vlenp)
+{ cache_set *sets = atomic_load_explicit(&cache_sets, memory_order_acquire);
+  uint64_t h = cache_hash(lang, key, klen);
+  cache_set *set = &sets[h & (cache_nsets-1)];
+  cache_counters *stats = &cache_stats[h & (CACHE_STRIPES-1)];
+  unsigned int seq = atomic_load_explicit(&set->seq, memory_order_acquire);
+  int way = CACHE_WAYS;
+
+  if ( !(seq&1) )			/* no writer active */
+  { for(way=0; way<CACHE_WAYS; way++)
+    { if ( cache_read_entry(&set->entries[way], lang, (uint32_t)h,
+			    key, klen, buf, vlenp) )
+	break;
+    }
+    atomic_thread_fence(memory_order_acquire);
+    if ( atomic_load_explicit(&set->seq, memory_order_relaxed) != seq )
+      way = CACHE_WAYS;			/* modified while reading */
+  }
+
+  if ( way < CACHE_WAYS )
+  { if ( !atomic_load_explicit(&set->referenced[way], memory_order_relaxed) )
+      atomic_store_explicit(&set->referenced[way], 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&stats->hits, 1, memory_order_relaxed);
+    return true;
+  }
+
+  atomic_fetch_add_explicit(&stats->misses, 1, memory_order_relaxed);
+  return false;
+}
+
+static void
+cache_add(atom_t lang, const char *key, size_t klen,
+	  const char *val, size_t vlen)
+{ cache_set *sets = atomic_load_explicit(&cache_sets, memory_order_acquire);
+  uint64_t h = cache_hash(lang, key, klen);
+  cache_set *set = &sets[h & (cache_nsets-1)];
+  uint64_t text[CACHE_WORDS-2];
+  unsigned int seq;
+  int way;
+  cache_entry *e;
+
+  if ( !cache_write_lock(set, &seq) )
+    return;				/* busy; do not wait */
+  for(way=0; way<CACHE_WAYS; way++)	/* added by another thread? */
+  { char buf[CACHE_TEXT_BYTES];
+    size_t l;
+
+    if ( cache_read_entry(&set->entries[way], lang, (uint32_t)h,
+			  key, klen, buf, &l) )
+    { cache_write_unlock(set, seq);
+      return;
+    }
+  }
+
+  for(;;)				/* CLOCK */
+  { way = set->hand;
+    set->hand = (set->hand+1) % CACHE_WAYS;
+    if ( !atomic_load_explicit(&set->entries[way].w[0], memory_order_relaxed) )
+      break;
+    if ( !atomic_exchange_explicit(&set->referenced[way], 0,
+				   memory_order_relaxed) )
+    { atomic_fetch_add_explicit(&cache_stats[h & (CACHE_STRIPES-1)].evictions,
+				1, memory_order_relaxed);
+      break;
+    }
+  }
+
+  e = &set->entries[way];
+  memset(text, 0, sizeof(text));
+  memcpy(text, key, klen);
+  memcpy((char*)text+klen, val, vlen);
+  atomic_store_explicit(&e->w[0], (uint64_t)lang, memory_order_relaxed);
+  atomic_store_explicit(&e->w[1],
+			(uint32_t)h | (uint64_t)klen<<32 | (uint64_t)vlen<<40,
+			memory_order_relaxed);
+  for(int i=0; i<CACHE_WORDS-2; i++)
+    atomic_store_explicit(&e->w[i+2], text[i], memory_order_relaxed);
+  atomic_store_explicit(&set->referenced[way], 0, memory_order_relaxed);
+  cache_write_unlock(set, seq);
+}
+
+static bool
+cache_alloc(void)
+{ cache_set *sets, *none = NULL;
+  size_t nsets;
+
+  if ( atomic_load(&cache_sets) )
+    return true;
+  for(nsets=1; nsets*CACHE_WAYS < cache_size; nsets *= 2)
+    ;
+  if ( !(sets = PL_malloc(nsets*sizeof(*sets))) )
+    return false;
+  memset(sets, 0, nsets*sizeof(*sets));
+  cache_nsets = nsets;
+  if ( !atomic_compare_exchange_strong(&cache_sets, &none, sets) )
+    PL_free(sets);			/* lost the race */
+
+  return true;
+}
+
+static void
+cache_clear(void)
+{ cache_set *sets = atomic_load(&cache_sets);
+
+  if ( sets )
+  { for(size_t i=0; i<cache_nsets; i++)
+    { cache_set *set = &sets[i];
+      unsigned int seq;
+
+      while ( !cache_write_lock(set, &seq) )
+	;
+      for(int way=0; way<CACHE_WAYS; way++)
+      { atomic_store_explicit(&set->entries[way].w[0], 0,
+			      memory_order_relaxed);
+	atomic_store_explicit(&set->referenced[way], 0, memory_order_relaxed);
+      }
+      cache_write_unlock(set, seq);
+    }
+  }
+}
+
+/* The acquire loads pair with setting pl->cached after cache_alloc() in
+   set_snowball_cache(), so cache_sets is non-NULL if this returns true.
+*/
+
+static bool
+cache_enabled(atom_t lang)
+{ pool_lang *pl;
+
+  return ( atomic_load_explicit(&cached_languages, memory_order_acquire) > 0 &&
+	   (pl=lookup_pool_lang(lang, false)) &&
+	   atomic_load_explicit(&pl->cached, memory_order_acquire) );
+}
+
+
+/* Stem the UTF-8 string s using the shared cache if enabled for lang.
+   buf provides room for a stem from the cache.
+*/
+
+static bool
+stem_word(atom_t lang, struct sb_stemmer *stemmer,
+	  const char *s, size_t len, char *buf,
+	  const char **stemp, size_t *slenp)
+{ bool cached = ( len <= CACHE_TEXT_BYTES && cache_enabled(lang) );
+  const sb_symbol *stemmed;
+  size_t olen;
+
+  if ( cached && cache_lookup(lang, s, len, buf, slenp) )
+  { *stemp = buf;
+    return true;
+  }
+
+  if ( !(stemmed = sb_stemmer_stem(stemmer, (const sb_symbol*)s, (int)len)) )
+    return PL_resource_error("memory");
+  olen = sb_stemmer_length(stemmer);
+  if ( cached && len+olen <= CACHE_TEXT_BYTES )
+    cache_add(lang, s, len, (const char*)stemmed, olen);
+
+  *stemp = (const char*)stemmed;
+  *slenp = olen;
+  return true;
+}
+
+
+static int
+snowball_text(term_t lang, term_t in, term_t out, int type)
 { struct sb_stemmer *stemmer = NULL;
+  atom_t alang;
   char *s;
   size_t len, olen;
-  const sb_symbol *stemmed;
+  const char *stemmed;
+  char buf[CACHE_TEXT_BYTES];
 
-  if ( !get_lang_stemmer(lang, &stemmer) )
+  if ( !get_lang_stemmer(lang, &stemmer) ||
+       !PL_get_atom(lang, &alang) )
     return false;
   if ( !PL_get_nchars(in, &len, &s,
 		      CVT_ATOM|CVT_STRING|CVT_LIST|REP_UTF8|CVT_EXCEPTION) )
     return false;
 
-  if ( !(stemmed = sb_stemmer_stem(stemmer, (const sb_symbol*)s, (int)len)) )
+  if ( !stem_word(alang, stemmer, s, len, buf, &stemmed, &olen) )
+    return false;
+
+  return PL_unify_chars(out, type|REP_UTF8, olen, stemmed);
+}
+
+
+static foreign_t
+snowball(term_t lang, term_t in, term_t out)
+{ return snowball_text(lang, in, out, PL_ATOM);
+}
+
+
+static foreign_t
+snowball4(term_t lang, term_t in, term_t out, term_t options)
+{ int type;
+
+  return ( get_text_type(options, &type) &&
+	   snowball_text(lang, in, out, type) );
+}
+
+
+/* snowball_list(+Lang, +Words, -Stems) looks up the stemmer once and
+   stems all elements of Words, building Stems as we go.
+*/
+
+static foreign_t
+snowball_list(term_t lang, term_t words, term_t stems)
+{ struct sb_stemmer *stemmer = NULL;
+  atom_t alang;
+  term_t tail = PL_copy_term_ref(words);
+  term_t head = PL_new_term_ref();
+  term_t stail = PL_copy_term_ref(stems);
+  term_t shead = PL_new_term_ref();
+  char buf[CACHE_TEXT_BYTES];
+
+  if ( !get_lang_stemmer(lang, &stemmer) ||
+       !PL_get_atom(lang, &alang) )
+    return false;
+
+  while( PL_get_list_ex(tail, head, tail) )
+  { char *s;
+    size_t len, olen;
+    const char *stemmed;
+
+    if ( !PL_get_nchars(head, &len, &s,
+			CVT_ATOM|CVT_STRING|CVT_LIST|REP_UTF8|CVT_EXCEPTION) )
+      return false;
+    if ( !stem_word(alang, stemmer, s, len, buf, &stemmed, &olen) )
+      return false;
+    if ( !PL_unify_list(stail, shead, stail) ||
+	 !PL_unify_chars(shead, PL_ATOM|REP_UTF8, olen, stemmed) )
+      return false;
+  }
+
+  return PL_get_nil_ex(tail) && PL_unify_nil(stail);
+}
+
+
+static foreign_t
+set_snowball_pool_size(term_t t_size)
+{ size_t size;
+
+  if ( !PL_get_size_ex(t_size, &size) )
+    return false;
+  if ( size > POOL_MAX_SIZE )
+    return PL_domain_error("snowball_pool_size", t_size);
+  atomic_store(&pool_size, (int)size);
+
+  return true;
+}
+
+
+/* snowball_pool_warm_up(+Lang, +Count) adds stemmers for Lang to the
+   pool until it holds Count of them or the pool is full.
+*/
+
+static foreign_t
+snowball_pool_warm_up(term_t t_lang, term_t t_count)
+{ struct sb_stemmer *stemmer;
+  atom_t lang;
+  size_t count, have = 0;
+  pool_lang *pl;
+
+  if ( !get_lang_stemmer(t_lang, &stemmer) ||	/* validate */
+       !PL_get_atom(t_lang, &lang) ||
+       !PL_get_size_ex(t_count, &count) )
+    return false;
+  if ( !(pl=lookup_pool_lang(lang, true)) )
     return PL_resource_error("memory");
-  olen = sb_stemmer_length(stemmer);
 
-  return PL_unify_chars(out, PL_ATOM|REP_UTF8, olen, (const char*)stemmed);
+  for(int i=0; i<POOL_MAX_SIZE; i++)
+  { if ( atomic_load(&pl->slots[i]) )
+      have++;
+  }
+
+  for( ; have < count; have++)
+  { struct sb_stemmer *st;
+
+    if ( !(st=new_stemmer(lang)) )
+    { if ( errno == ENOMEM )
+	return PL_resource_error("memory");
+      else
+	return PL_domain_error("snowball_algorithm", t_lang);
+    }
+    if ( !return_stemmer(lang, st) )
+      break;				/* pool is full */
+  }
+
+  return true;
+}
+
+
+static foreign_t
+snowball_pool_statistics(term_t stat)
+{ long created = atomic_load(&stemmers_created);
+  long deleted = atomic_load(&stemmers_deleted);
+
+  return PL_unify_term(stat,
+		       PL_FUNCTOR_CHARS, "snowball_pool", 5,
+			 PL_INT, atomic_load(&pool_size),
+			 PL_INT64, (int64_t)created,
+			 PL_INT64, (int64_t)(created-deleted),
+			 PL_INT64, (int64_t)atomic_load(&stemmers_pooled),
+			 PL_INT64, (int64_t)atomic_load(&stemmers_reused));
+}
+
+
+static foreign_t
+set_snowball_cache(term_t t_lang, term_t t_enable)
+{ struct sb_stemmer *stemmer;
+  atom_t lang;
+  int enable;
+  pool_lang *pl;
+
+  if ( !get_lang_stemmer(t_lang, &stemmer) ||	/* validate */
+       !PL_get_atom(t_lang, &lang) ||
+       !PL_get_bool_ex(t_enable, &enable) )
+    return false;
+  if ( !(pl=lookup_pool_lang(lang, true)) ||
+       (enable && !cache_alloc()) )
+    return PL_resource_error("memory");
+
+  if ( atomic_exchange(&pl->cached, enable) != (bool)enable )
+    atomic_fetch_add(&cached_languages, enable ? 1 : -1);
+
+  return true;
+}
+
+
+static foreign_t
+set_snowball_cache_size(term_t t_size)
+{ size_t size;
+
+  if ( !PL_get_size_ex(t_size, &size) )
+    return false;
+  if ( atomic_load(&cache_sets) )
+    return PL_permission_error("resize", "snowball_cache", t_size);
+  if ( size < CACHE_WAYS || size > 0x10000000 )
+    return PL_domain_error("snowball_cache_size", t_size);
+  cache_size = size;
+
+  return true;
+}
+
+
+static foreign_t
+snowball_cache_clear(void)
+{ cache_clear();
+  for(int i=0; i<CACHE_STRIPES; i++)
+  { atomic_store(&cache_stats[i].hits, 0);
+    atomic_store(&cache_stats[i].misses, 0);
+    atomic_store(&cache_stats[i].evictions, 0);
+  }
+
+  return true;
+}
+
+
+static foreign_t
+snowball_cache_statistics(term_t stat)
+{ int64_t hits = 0, misses = 0, evictions = 0;
+  size_t size = atomic_load(&cache_sets) ? cache_nsets*CACHE_WAYS
+					  : cache_size;
+
+  for(int i=0; i<CACHE_STRIPES; i++)
+  { hits      += atomic_load(&cache_stats[i].hits);
+    misses    += atomic_load(&cache_stats[i].misses);
+    evictions += atomic_load(&cache_stats[i].evictions);
+  }
+
+  return PL_unify_term(stat,
+		       PL_FUNCTOR_CHARS, "snowball_cache", 4,
+			 PL_INT64, (int64_t)size,
+			 PL_INT64, hits,
+			 PL_INT64, misses,
+			 PL_INT64, evictions);
 }
 
 
@@ -177,11 +789,450 @@ snowball_algorithms(term_t list)
   return PL_unify_nil(tail);
 }
 
+		 /*******************************
+		 *	  ANALYSIS PIPELINE	*
+		 *******************************/
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+An nlp_pipeline blob describes the analysis  of text into index terms: the
+text is split using tokenizeW() from  tokenize.ic, after which each word
+is case folded using casefold.ic, stripped from accents using unaccent.ic,
+compared to a set of stop words and finally  stemmed using the snowball
+stemmer of the calling thread.  Only the resulting terms are created as
+Prolog text.  Stop words are either  a   stopword_set  blob created by
+stopword_set_create/3 or a list of words that is normalized with the same
+steps and compiled into a stopword_set.
+- - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+#include "tokenize.ic"
+#include "casefold.ic"
+#include "unaccent.ic"
+#include "normalize.ic"
+#include "stopwords.ic"
+
+#define NLP_CASEFOLD	NORM_CASEFOLD
+#define NLP_UNACCENT	NORM_UNACCENT
+#define NLP_NUMBERS	0x4
+
+typedef struct nlp_pipeline
+{ atom_t	stem;			/* snowball algorithm or 0 */
+  int		flags;			/* NLP_* */
+  int		type;			/* PL_ATOM, PL_STRING, ... */
+  stopword_set *stop;			/* stop words or NULL */
+  atom_t	stop_blob;		/* blob holding stop or 0 */
+} nlp_pipeline;
+
+typedef struct wbuf
+{ wchar_t      *base;
+  size_t	size;
+  wchar_t	fast[256];
+} wbuf;
+
+static void
+free_pipeline(nlp_pipeline *p)
+{ if ( p->stop_blob )
+    PL_unregister_atom(p->stop_blob);
+  else if ( p->stop )
+    free_stopword_set(p->stop);
+  if ( p->stem )
+    PL_unregister_atom(p->stem);
+  free(p);
+}
+
+static int
+release_nlp_pipeline(atom_t symbol)
+{ nlp_pipeline **pp = PL_blob_data(symbol, NULL, NULL);
+
+  free_pipeline(*pp);
+
+  return TRUE;
+}
+
+static int
+write_nlp_pipeline(IOSTREAM *s, atom_t symbol, int flags)
+{ nlp_pipeline **pp = PL_blob_data(symbol, NULL, NULL);
+
+  Sfprintf(s, "<nlp_pipeline>(%p)", *pp);
+  return TRUE;
+}
+
+static PL_blob_t nlp_pipeline_blob =
+{ PL_BLOB_MAGIC,
+  PL_BLOB_NOCOPY,
+  "nlp_pipeline",
+  release_nlp_pipeline,
+  NULL,
+  write_nlp_pipeline
+};
+
+static int
+get_nlp_pipeline(term_t t, nlp_pipeline **pp)
+{ void *data;
+  PL_blob_t *type;
+
+  if ( PL_get_blob(t, &data, NULL, &type) && type == &nlp_pipeline_blob )
+  { nlp_pipeline **ref = data;
+
+    *pp = *ref;
+    return TRUE;
+  }
+
+  return PL_type_error("nlp_pipeline", t);
+}
+
+
+static bool
+wbuf_ensure(wbuf *b, size_t len)
+{ if ( len > b->size )
+  { wchar_t *n = (b->base == b->fast ? malloc(len*sizeof(wchar_t))
+				      : realloc(b->base, len*sizeof(wchar_t)));
+    if ( !n )
+      return false;
+    b->base = n;
+    b->size = len;
+  }
+
+  return true;
+}
+
+static void
+wbuf_free(wbuf *b)
+{ if ( b->base != b->fast )
+    free(b->base);
+}
+
+/* Normalize a word according to flags into b and return its length or
+   (size_t)-1 if we are out of memory.
+*/
+
+static size_t
+normalize_word(const wchar_t *s, size_t len, int flags, wbuf *b)
+{ size_t o = normalize_text(s, len, flags, b->base, b->size);
+
+  if ( o > b->size )
+  { if ( !wbuf_ensure(b, o) )
+      return (size_t)-1;
+    normalize_text(s, len, flags, b->base, b->size);
+  }
+
+  return o;
+}
+
+/* Encode s as UTF-8 into out, which must have room for 4*len bytes */
+
+static size_t
+utf8_encode(const wchar_t *s, size_t len, char *out)
+{ unsigned char *o = (unsigned char*)out;
+
+  for(size_t i=0; i<len; i++)
+  { unsigned int c = (unsigned int)s[i];
+
+    if ( c < 0x80 )
+    { *o++ = c;
+    } else if ( c < 0x800 )
+    { *o++ = 0xc0|(c>>6);
+      *o++ = 0x80|(c&0x3f);
+    } else if ( c < 0x10000 )
+    { *o++ = 0xe0|(c>>12);
+      *o++ = 0x80|((c>>6)&0x3f);
+      *o++ = 0x80|(c&0x3f);
+    } else
+    { *o++ = 0xf0|(c>>18);
+      *o++ = 0x80|((c>>12)&0x3f);
+      *o++ = 0x80|((c>>6)&0x3f);
+      *o++ = 0x80|(c&0x3f);
+    }
+  }
+
+  return (char*)o - out;
+}
+
+
+/* Compile a list of stop words, normalized according to flags, into
+   p->stop.
+*/
+
+static int
+compile_stop_words(nlp_pipeline *p, term_t list, size_t n)
+{ term_t tail = PL_copy_term_ref(list);
+  term_t head = PL_new_term_ref();
+  wbuf b = { .base = b.fast, .size = sizeof(b.fast)/sizeof(wchar_t) };
+  stopword *words;
+  size_t i = 0;
+  int rc = false;
+
+  if ( !(words = calloc(n+1, sizeof(*words))) )
+    return PL_resource_error("memory");
+
+  for( ; PL_get_list(tail, head, tail); i++)
+  { wchar_t *s;
+    size_t len;
+    char *u;
+
+    if ( !PL_get_wchars(head, &len, &s, CVT_ATOM|CVT_STRING|CVT_EXCEPTION) )
+      goto out;
+    if ( (len = normalize_word(s, len, p->flags, &b)) == (size_t)-1 ||
+	 !(u = malloc(len*4+1)) )
+    { PL_resource_error("memory");
+      goto out;
+    }
+    words[i].s   = u;
+    words[i].len = utf8_encode(b.base, len, u);
+  }
+
+  if ( !(p->stop = build_stopword_set(words, n,
+				      p->flags&(NLP_CASEFOLD|NLP_UNACCENT),
+				      0)) )
+    PL_resource_error("memory");
+  else
+    rc = true;
+
+out:
+  for(size_t k=0; k<n; k++)
+    free((char*)words[k].s);
+  free(words);
+  wbuf_free(&b);
+
+  return rc;
+}
+
+
+static foreign_t
+nlp_pipeline_create(term_t t_stem, term_t t_flags, term_t t_stop,
+		    term_t options, term_t t_pipeline)
+{ nlp_pipeline *p;
+  struct sb_stemmer *stemmer;
+  stopword_set *set = NULL;
+  atom_t stem;
+  int flags, type;
+  size_t nstop = 0;
+
+  if ( !PL_get_atom_ex(t_stem, &stem) ||
+       !PL_get_integer_ex(t_flags, &flags) ||
+       !get_text_type(options, &type) )
+    return false;
+  if ( PL_skip_list(t_stop, 0, &nstop) != PL_LIST )
+  { if ( !PL_is_blob(t_stop, NULL) )	/* [] is a blob too */
+      return PL_type_error("list", t_stop);
+    if ( !get_stopword_set(t_stop, &set) )
+      return false;
+  }
+  if ( stem == ATOM_none )
+    stem = 0;
+  else if ( !get_lang_stemmer(t_stem, &stemmer) )	/* validate */
+    return false;
+  if ( set && ( set->stem != stem ||
+		set->flags != (flags&(NLP_CASEFOLD|NLP_UNACCENT)) ) )
+    return PL_domain_error("stopword_set", t_stop);
+
+  if ( !(p = calloc(1, sizeof(*p))) )
+    return PL_resource_error("memory");
+  p->flags = flags;
+  p->type  = type;
+  if ( (p->stem = stem) )
+    PL_register_atom(stem);
+  if ( set )
+  { PL_get_atom(t_stop, &p->stop_blob);
+    PL_register_atom(p->stop_blob);
+    p->stop = set;
+  } else if ( nstop > 0 && !compile_stop_words(p, t_stop, nstop) )
+  { free_pipeline(p);
+    return false;
+  }
+
+  return PL_unify_blob(t_pipeline, &p, sizeof(p), &nlp_pipeline_blob);
+}
+
+
+/* True if the float token s is a valid Prolog float.  If not, e.g., if
+   it is too large, the tokenizer passes it as part of a word, as
+   tokenize_atom/2 does.  See put_number() in porter_stem.c.  Raises a
+   resource error and returns false if we are out of memory.
+*/
+
+static bool
+is_float_token(const wchar_t *s, size_t len)
+{ char buf[100];
+  char *a = buf, *e;
+  bool rc;
+
+  if ( len >= sizeof(buf) && !(a = malloc(len+1)) )
+    return PL_resource_error("memory");
+  for(size_t i=0; i<len; i++)
+    a[i] = (char)s[i];
+  a[len] = '\0';
+
+  errno = 0;
+  (void)strtod(a, &e);			/* e != end: locale decimal point */
+  if ( e == &a[len] && errno != ERANGE )
+  { rc = true;
+  } else
+  { term_t t = PL_new_term_ref();
+
+    rc = PL_chars_to_term(a, t);
+    PL_reset_term_refs(t);
+  }
+  if ( a != buf )
+    free(a);
+
+  return rc;
+}
+
+
+typedef struct analysis
+{ nlp_pipeline	    *pipeline;
+  struct sb_stemmer *stemmer;
+  term_t	     tail;
+  term_t	     head;
+  wbuf		     word;		/* normalized word */
+  char		    *utf8;		/* UTF-8 version */
+  size_t	     utf8_size;
+  char		     utf8_fast[1024];
+} analysis;
+
+static int
+analyze_token(const wchar_t *s, size_t len, toktype type, void *closure)
+{ analysis *a = closure;
+  nlp_pipeline *p = a->pipeline;
+  size_t wlen, ulen;
+  const char *term;
+  size_t tlen;
+  char buf[CACHE_TEXT_BYTES];
+
+  switch(type)
+  { case TOK_PUNCT:
+      return TRUE;
+    case TOK_FLOAT:
+      if ( !is_float_token(s, len) )	/* handle as word */
+	return FALSE;
+      /*FALLTHROUGH*/
+    case TOK_INT:
+      if ( !(p->flags&NLP_NUMBERS) )
+	return TRUE;
+      return ( PL_unify_list(a->tail, a->head, a->tail) &&
+	       PL_unify_wchars(a->head, p->type, len, s) );
+    default:
+      break;
+  }
+
+  if ( (wlen=normalize_word(s, len, p->flags, &a->word)) == (size_t)-1 )
+    return PL_resource_error("memory");
+  if ( wlen == 0 )
+    return TRUE;
+
+  if ( wlen*4 > a->utf8_size )
+  { char *n = (a->utf8 == a->utf8_fast ? malloc(wlen*4)
+					: realloc(a->utf8, wlen*4));
+    if ( !n )
+      return PL_resource_error("memory");
+    a->utf8 = n;
+    a->utf8_size = wlen*4;
+  }
+  ulen = utf8_encode(a->word.base, wlen, a->utf8);
+  if ( p->stop && !p->stop->stem && stopword_lookup(p->stop, a->utf8, ulen) )
+    return TRUE;
+
+  if ( a->stemmer )
+  { if ( !stem_word(p->stem, a->stemmer, a->utf8, ulen, buf, &term, &tlen) )
+      return FALSE;
+    if ( p->stop && p->stop->stem && stopword_lookup(p->stop, term, tlen) )
+      return TRUE;
+  } else
+  { term = a->utf8;
+    tlen = ulen;
+  }
+
+  return ( PL_unify_list(a->tail, a->head, a->tail) &&
+	   PL_unify_chars(a->head, p->type|REP_UTF8, tlen, term) );
+}
+
+
+/* Tokens of ISO Latin-1 text are widened one at a time */
+
+static int
+analyze_tokenA(const char *s, size_t len, toktype type, void *closure)
+{ wchar_t tmp[256];
+  wchar_t *w = len > sizeof(tmp)/sizeof(wchar_t) ?
+			malloc(len*sizeof(wchar_t)) : tmp;
+  int rc;
+
+  if ( !w )
+    return PL_resource_error("memory");
+  for(size_t i=0; i<len; i++)
+    w[i] = s[i]&0xff;
+  rc = analyze_token(w, len, type, closure);
+  if ( w != tmp )
+    free(w);
+
+  return rc;
+}
+
+
+static foreign_t
+nlp_analyze(term_t t_pipeline, term_t text, term_t terms)
+{ nlp_pipeline *p;
+  analysis a = {0};
+  char *sA = NULL;
+  wchar_t *s = NULL;
+  size_t len;
+  int rc;
+
+  if ( !get_nlp_pipeline(t_pipeline, &p) )
+    return false;
+  if ( !PL_get_nchars(text, &len, &sA, CVT_ALL) &&
+       !PL_get_wchars(text, &len, &s, CVT_ALL|CVT_EXCEPTION) )
+    return false;
+  if ( p->stem )
+  { term_t t = PL_new_term_ref();
+
+    if ( !PL_put_atom(t, p->stem) ||
+	 !get_lang_stemmer(t, &a.stemmer) )
+      return false;
+  }
+
+  a.pipeline  = p;
+  a.tail      = PL_copy_term_ref(terms);
+  a.head      = PL_new_term_ref();
+  a.word.base = a.word.fast;
+  a.word.size = sizeof(a.word.fast)/sizeof(wchar_t);
+  a.utf8      = a.utf8_fast;
+  a.utf8_size = sizeof(a.utf8_fast);
+
+  rc = ( (sA ? tokenizeA(sA, len, analyze_tokenA, &a)
+	      : tokenizeW(s, len, analyze_token, &a)) &&
+	 PL_unify_nil(a.tail) );
+
+  wbuf_free(&a.word);
+  if ( a.utf8 != a.utf8_fast )
+    free(a.utf8);
+
+  return rc;
+}
+
+
 install_t
 install_snowball(void)
 { assert(sizeof(sb_symbol) == sizeof(char));
 
+  init_text_type();
+  ATOM_none = PL_new_atom("none");
+
   PL_register_foreign("snowball", 3, snowball, 0);
+  PL_register_foreign("snowball", 4, snowball4, 0);
+  PL_register_foreign("snowball_list", 3, snowball_list, 0);
   PL_register_foreign("snowball_algorithms", 1, snowball_algorithms, 0);
+  PL_register_foreign("set_snowball_pool_size", 1,
+		      set_snowball_pool_size, 0);
+  PL_register_foreign("snowball_pool_warm_up", 2, snowball_pool_warm_up, 0);
+  PL_register_foreign("$snowball_pool_statistics", 1,
+		      snowball_pool_statistics, 0);
+  PL_register_foreign("set_snowball_cache", 2, set_snowball_cache, 0);
+  PL_register_foreign("set_snowball_cache_size", 1,
+		      set_snowball_cache_size, 0);
+  PL_register_foreign("snowball_cache_clear", 0, snowball_cache_clear, 0);
+  PL_register_foreign("$snowball_cache_statistics", 1,
+		      snowball_cache_statistics, 0);
+  PL_register_foreign("$nlp_pipeline_create", 5, nlp_pipeline_create, 0);
+  PL_register_foreign("nlp_analyze", 3, nlp_analyze, 0);
   PL_thread_at_exit(stem_destroy_cache, NULL, true);
 }
@@ -34,9 +34,23 @@
 
 :- module(snowball,
           [ snowball/3,                  % +Algorithm, +In, -Out
-            snowball_current_algorithm/1 % ?algorithm
+            snowball/4,                  % +Algorithm, +In, -Out, +Options
+            snowball_list/3,             % +Algorithm, +Words, -Stems
+            snowball_current_algorithm/1, % ?algorithm
+            set_snowball_pool_size/1,    % +Size
+            snowball_pool_warm_up/2,     % +Algorithm, +Count
+            snowball_pool_property/1,    % ?Property
+            set_snowball_cache/2,        % +Algorithm, +Boolean
+            set_snowball_cache_size/1,   % +Entries
+            snowball_cache_clear/0,
+            snowball_cache_property/1,   % ?Property
+            nlp_pipeline_create/2,       % +Spec, -Pipeline
+            nlp_analyze/3                % +Pipeline, +Text, -Terms
           ]).
 :- autoload(library(apply),[maplist/3]).
+:- autoload(library(lists),[member/2]).
+:- autoload(library(option),[option/2, option/3]).
+:- autoload(library(error),[must_be/2]).
 
 /** <module> The Snowball multi-lingual stemmer library
 
@@ -46,6 +60,7 @@ languages.  The interface to this library is very simple:
 
     * snowball/3 stems a word with a given algorithm
     * snowball_current_algorithm/1 enumerates the provided algorithms.
+    * nlp_analyze/3 turns text into a list of stemmed index terms.
 
 Here is an example:
 
@@ -66,7 +81,9 @@ Here is an example:
 %
 %   The implementation maintains a cache of stemmers for each thread
 %   that  accesses  snowball/3,   providing    high-perfomance   and
-%   thread-safety without locking.
+%   thread-safety without locking.  When a thread terminates, its
+%   stemmers are moved to a process-wide pool from which other threads
+%   borrow them.  See set_snowball_pool_size/1.
 %
 %   @param  Algorithm is the (english) name for desired algorithm
 %           or an 2 or 3 letter ISO 639 language code.
@@ -78,11 +95,187 @@ Here is an example:
 %   @error type_error(atom, Algorithm)
 %   @error type_error(text, Input)
 
+%!  snowball(+Algorithm, +Input, -Stem, +Options) is det.
+%
+%   As snowball/3, using Options to control the type of Stem. The only
+%   option is type(Type), where Type  is   one  of `atom` (default),
+%   `string`, `codes` or `chars`.  Using   strings  avoids  creating
+%   atoms when stemming large amounts of text.
+%
+%   @error domain_error(text_type, Type)
+
+%!  snowball_list(+Algorithm, +Words, -Stems) is det.
+%
+%   As maplist(snowball(Algorithm), Words, Stems), but stemming all
+%   elements of Words in a single call using the same stemmer.
+%
+%   @error type_error(list, Words)
+
 %!  snowball_current_algorithm(?Algorithm) is nondet.
 %
 %   True if Algorithm is the official  name of an algorithm suported
 %   by snowball/3. The predicate is =semidet= if Algorithm is given.
 
+%!  set_snowball_pool_size(+Size) is det.
+%
+%   Set the maximum number of idle stemmers kept per algorithm in the
+%   process-wide pool.  Stemmers of terminating threads that do not
+%   fit in the pool are deleted.  The default is 8, the maximum is 64
+%   and 0 disables the pool.
+%
+%   @error domain_error(snowball_pool_size, Size)
+
+%!  snowball_pool_warm_up(+Algorithm, +Count) is det.
+%
+%   Add stemmers for Algorithm to the pool until it holds Count of
+%   them or the pool is full.  Calling this at startup avoids creating
+%   stemmers when threads that are started on demand, such as HTTP
+%   workers, first call snowball/3.
+%
+%   @error domain_error(snowball_algorithm, Algorithm)
+
+%!  snowball_pool_property(?Property) is nondet.
+%
+%   True when Property describes the process-wide stemmer pool.
+%   Defined properties are:
+%
+%     - size(-Size)
+%       Maximum number of idle stemmers per algorithm.
+%     - created(-Count)
+%       Total number of stemmers created.
+%     - live(-Count)
+%       Number of stemmers that currently exist, either in use by a
+%       thread or idle in the pool.
+%     - pooled(-Count)
+%       Number of idle stemmers in the pool.
+%     - reused(-Count)
+%       Number of times a thread borrowed a stemmer from the pool.
+
+snowball_pool_property(Property) :-
+    '$snowball_pool_statistics'(
+        snowball_pool(Size, Created, Live, Pooled, Reused)),
+    member(Property,
+           [ size(Size),
+             created(Created),
+             live(Live),
+             pooled(Pooled),
+             reused(Reused)
+           ]).
+
+%!  set_snowball_cache(+Algorithm, +Boolean) is det.
+%
+%   Enable or disable the process-wide  result   cache  for Algorithm.
+%   When enabled, snowball/3,  snowball/4   and  snowball_list/3 first
+%   look up the word in a table that is shared by all threads and add
+%   the result after stemming.  Lookups do not lock.  This pays off if
+%   many threads stem the same vocabulary.  Only words for which the
+%   UTF-8 encoding of the word and its stem together take at most 48
+%   bytes are cached.
+%
+%   @error domain_error(snowball_algorithm, Algorithm)
+
+%!  set_snowball_cache_size(+Entries) is det.
+%
+%   Set the number of entries of the result cache, which is rounded up
+%   to a power of two.  Each entry takes 64 bytes.  The default is
+%   65,536.  The size can only be changed before the cache is enabled
+%   for the first algorithm.  When full, entries are replaced using an
+%   approximation of _least recently used_.
+%
+%   @error permission_error(resize, snowball_cache, Entries)
+
+%!  snowball_cache_clear is det.
+%
+%   Remove all entries from the result cache and reset its counters.
+
+%!  snowball_cache_property(?Property) is nondet.
+%
+%   True when Property describes the result cache.  Defined properties
+%   are size(Entries), hits(Count), misses(Count) and
+%   evictions(Count).
+
+snowball_cache_property(Property) :-
+    '$snowball_cache_statistics'(
+        snowball_cache(Size, Hits, Misses, Evictions)),
+    member(Property,
+           [ size(Size),
+             hits(Hits),
+             misses(Misses),
+             evictions(Evictions)
+           ]).
+
+%!  nlp_pipeline_create(+Spec:list, -Pipeline) is det.
+%
+%   Create a pipeline for nlp_analyze/3.  Spec is a list of options:
+%
+%     - stem(+Algorithm)
+%       Stem words using the snowball Algorithm.  Default is `none`,
+%       which does not stem.
+%     - casefold(+Boolean)
+%       Map words to lower case using Unicode simple case folding.
+%       Default `true`.
+%     - unaccent(+Boolean)
+%       Remove accents as unaccent_atom/2.  Default `false` as
+%       several snowball algorithms use the accents.
+%     - stopwords(+ListOrSet)
+%       Remove words that appear in List after case folding and
+%       removing accents.  Default `[]`.  This may also be a set
+%       created using stopword_set_create/3 with the same
+%       stem, casefold and unaccent options.  A set created without
+%       a stem option is compared to the normalized word, a set
+%       created with stem(Algorithm) to the stem.
+%     - numbers(+Boolean)
+%       If `true` (default), include numbers as text.
+%     - type(+Type)
+%       Type of the terms as snowball/4.  Default `atom`.
+%
+%   Pipeline is reclaimed by atom garbage collection and may be used
+%   concurrently by multiple threads.
+%
+%   @error domain_error(snowball_algorithm, Algorithm)
+%   @error domain_error(stopword_set, Set) if the stopword set was
+%   created with a different stemmer or normalization.
+
+nlp_pipeline_create(Spec, Pipeline) :-
+    option(stem(Algorithm), Spec, none),
+    option(casefold(CaseFold), Spec, true),
+    option(unaccent(UnAccent), Spec, false),
+    option(numbers(Numbers), Spec, true),
+    option(stopwords(StopWords), Spec, []),
+    bool_flag(CaseFold, 0x1, F1),
+    bool_flag(UnAccent, 0x2, F2),
+    bool_flag(Numbers,  0x4, F3),
+    Flags is F1\/F2\/F3,
+    include_type(Spec, TypeOptions),
+    '$nlp_pipeline_create'(Algorithm, Flags, StopWords, TypeOptions,
+                           Pipeline).
+
+bool_flag(true,  Flag, Flag) :- !.
+bool_flag(false, _,    0) :- !.
+bool_flag(Value, _,    _) :-
+    must_be(boolean, Value).
+
+include_type(Spec, [type(Type)]) :-
+    option(type(Type), Spec),
+    !.
+include_type(_, []).
+
+%!  nlp_analyze(+Pipeline, +Text, -Terms:list) is det.
+%
+%   Split Text into words and numbers as tokenize_atom/2, normalize
+%   and stem the words as specified by Pipeline and unify Terms with
+%   the result.  Punctuation and stop words are removed.  Numbers are
+%   returned as text.  As with tokenize_atom/2, a float that cannot be
+%   represented, as in `1e400a`, is part of a word.  The whole
+%   analysis is done in C without creating intermediate atoms.  For
+%   example:
+%
+%       ==
+%       ?- nlp_pipeline_create([stem(english), stopwords([the])], P),
+%          nlp_analyze(P, "The Walking Dead", Terms).
+%       Terms = [walk, dead].
+%       ==
+
 term_expansion(snowball_current_algorithm(dummy), Clauses) :-
     snowball_algorithms(Algos),
     maplist(wrap, Algos, Clauses).
@@ -95,3 +288,9 @@ snowball_current_algorithm(dummy).
     sandbox:safe_primitive/1.
 
 sandbox:safe_primitive(snowball:snowball(_,_,_)).
+sandbox:safe_primitive(snowball:snowball(_,_,_,_)).
+sandbox:safe_primitive(snowball:snowball_list(_,_,_)).
+sandbox:safe_primitive(snowball:'$snowball_pool_statistics'(_)).
+sandbox:safe_primitive(snowball:'$snowball_cache_statistics'(_)).
+sandbox:safe_primitive(snowball:'$nlp_pipeline_create'(_,_,_,_,_)).
+sandbox:safe_primitive(snowball:nlp_analyze(_,_,_)).
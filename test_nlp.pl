@@ -38,15 +38,30 @@
           [ test_nlp/0
           ]).
 :- use_module(library(plunit)).
-:- autoload(library(double_metaphone),[double_metaphone/2]).
+:- autoload(library(double_metaphone),
+	    [double_metaphone/2,double_metaphone/4,double_metaphone_list/3]).
 :- autoload(library(porter_stem),
-	    [porter_stem/2,tokenize_atom/2,atom_to_stem_list/2]).
+	    [porter_stem/2,porter_stem/3,porter_stem_list/2,unaccent_atom/2,
+	     tokenize_atom/2,tokenize_atom/3,
+	     atom_to_stem_list/2,atom_to_stem_list/3,
+	     tokenize_spans/2,tokenize_stream/2,tokenize_stream_lazy/2,
+	     porter_stem_cache_clear/0,porter_stem_cache_property/1,
+	     stopword_set_create/3]).
 :- autoload(library(snowball)).
+:- autoload(library(isub),
+            [isub/4, isub_tokens/4, isub_prepare/3, isub_many/3,
+             isub_best/4, isub_above/4, isub_join/5, isub_index_create/3,
+             isub_index_delete/2, isub_index_query/4, isub_dict_create/3,
+             isub_dict_query/4]).
+:- autoload(library(apply), [maplist/3]).
+:- autoload(library(lists), [member/2, numlist/3]).
+:- autoload(library(lazy_lists), [lazy_list_materialize/1]).
 
 test_nlp :-
     run_tests([ stem,
                 metaphone,
-                snowball
+                snowball,
+                isub
               ]).
 
 :- begin_tests(stem).
@@ -55,10 +70,88 @@ test(stem, [true(X==walk)]) :-
     porter_stem(walks, X).
 test(stem, [true(X==walk)]) :-
     porter_stem(walk, X).
+test(stem_list, [true(X==[walk, bicycl, run])]) :-
+    porter_stem_list([walks, bicycles, "running"], X).
+test(stem, [true(X=="walk")]) :-
+    porter_stem(walks, X, [type(string)]).
+test(tokens, [true(X==["hello", 42, "world", "!"])]) :-
+    tokenize_atom('hello 42 world!', X, [type(string)]).
+test(stem_list, [true(X==[`hello`, `world`])]) :-
+    atom_to_stem_list('hello worlds!', X, [type(codes)]).
 test(tokens, [true(X==[hello, world, !])]) :-
     tokenize_atom('hello world!', X).
+test(tokens, [true(X==[x, 42, -7, 1500.0, 0.25, '1e400a'])]) :-
+    tokenize_atom('x 42 -7 1.5e3 2.5e-1 1e400a', X).
+test(spans, [true(X == [word-0-5, integer-6-2, punct-8-1, float-10-3,
+                        word-14-6])]) :-
+    tokenize_spans('hello 42, 1.5 1e400a', X).
+test(stream, [true(Tokens == Expected)]) :-
+    numlist(1, 2000, Numbers),
+    atomic_list_concat(Numbers, ' word-', Text),
+    tokenize_atom(Text, Expected),
+    retractall(stream_token(_)),
+    setup_call_cleanup(
+        open_string(Text, In),
+        tokenize_stream(In, assert_stream_token),
+        close(In)),
+    findall(T, retract(stream_token(T)), Tokens).
+test(stream, [true(Tokens == Expected)]) :-
+    numlist(1, 3000, Numbers),
+    atomic_list_concat(Numbers, ',-1.5e-3;a', Text),
+    tokenize_atom(Text, Expected),
+    setup_call_cleanup(
+        open_string(Text, In),
+        ( tokenize_stream_lazy(In, Tokens),
+          lazy_list_materialize(Tokens)
+        ),
+        close(In)).
+test(stream, [true(Tokens == [hello, 42, world, !])]) :-
+    setup_call_cleanup(
+        open_string("  hello 42\nworld! ", In),
+        ( tokenize_stream_lazy(In, Tokens),
+          lazy_list_materialize(Tokens)
+        ),
+        close(In)).
 test(stem_list, [true(X==[hello, world])]) :-
     atom_to_stem_list('hello worlds!', X).
+test(stem_list, [true(X==[hello, 'мир', walk, 42])]) :-
+    atom_to_stem_list('Hello МИР walks 42', X).
+test(cache, [true(Hits-X == 1-walk)]) :-
+    porter_stem_cache_clear,
+    porter_stem(walks, _),
+    porter_stem(walks, X),
+    porter_stem_cache_property(hits(Hits)).
+test(stem, [true(X==lodz)]) :-
+    porter_stem('Łódź', X).
+test(unaccent, [true(X=='Tieng Viet')]) :-
+    unaccent_atom('Tiếng Việt', X).
+test(unaccent, [true(X==Y)]) :-
+    Y = 'a plain ASCII prefix longer than 32 bytes, then cafe',
+    unaccent_atom('a plain ASCII prefix longer than 32 bytes, then café', X).
+test(unaccent, [true(X==Y)]) :-
+    Y = 'a plain ASCII text longer than 32 bytes, without accents',
+    unaccent_atom(Y, X).
+test(stem, [true(X=='москва')]) :-
+    porter_stem('Москва', X).
+test(stem, [true(X=='αθηνα')]) :-
+    porter_stem('ΑΘΉΝΑ', X).
+test(stem, [true(X==[елка, walk])]) :-
+    atom_to_stem_list('ЁЛКА walks', X).
+
+test(stopwords, [true(X==[cat, sat, mat])]) :-
+    stopword_set_create([the, "on", 'A'], S, []),
+    tokenize_atom('The cat sat on a mat', X, [stopwords(S)]).
+test(stopwords, [true(X==[sat])]) :-
+    stopword_set_create([cat], S, [stem(porter)]),
+    atom_to_stem_list('Cats sat', X, [stopwords(S)]).
+test(stopwords, [error(domain_error(stopword_set, _))]) :-
+    stopword_set_create([walking], S, [stem(english)]),
+    tokenize_atom('Walking home', _, [stopwords(S)]).
+
+:- dynamic stream_token/1.
+
+assert_stream_token(Token) :-
+    assertz(stream_token(Token)).
 
 :- end_tests(stem).
 
@@ -66,12 +159,69 @@ test(stem_list, [true(X==[hello, world])]) :-
 
 test(metaphone, [true(X=='ARLT')]) :-
     double_metaphone(world, X).
+test(metaphone, [true(X-Y=="ARLT"-"FRLT")]) :-
+    double_metaphone(world, X, Y, [type(string)]).
+test(metaphone_list, [true(X-Y==['ARLT','SM0']-['FRLT','XMT'])]) :-
+    double_metaphone_list([world, "smith"], X, Y).
 
 :- end_tests(metaphone).
 
 
 :- begin_tests(snowball).
 
+test(snowball_list, [true(X==[walk, walk, run])]) :-
+    snowball_list(english, [walking, "walked", runs], X).
+test(snowball_list, [error(type_error(list, _))]) :-
+    snowball_list(english, [walking|foo], _).
+test(snowball_pool, [true(Pooled >= 2)]) :-
+    snowball_pool_warm_up(dutch, 2),
+    snowball_pool_property(pooled(Pooled)).
+test(snowball_shared_cache,
+     [ true(X-Y==walk-walk),
+       cleanup(set_snowball_cache(english, false))
+     ]) :-
+    set_snowball_cache(english, true),
+    snowball_cache_property(hits(H0)),
+    snowball(english, walking, X),
+    snowball(english, "walking", Y),
+    snowball_cache_property(hits(H1)),
+    assertion(H1 > H0).
+test(pipeline, [true(X==['1e400a', '1.5'])]) :-
+    nlp_pipeline_create([], P),
+    nlp_analyze(P, "1e400a 1.5", X).
+test(pipeline, [true(X==[walk, dead])]) :-
+    nlp_pipeline_create([stem(english)], P),
+    nlp_analyze(P, "Walking dead", X).
+test(pipeline, [true(X==[walk, dead])]) :-
+    nlp_pipeline_create([stem(english), stopwords([])], P),
+    nlp_analyze(P, "Walking dead", X).
+test(pipeline, [true(X==[walk, dead, '2'])]) :-
+    nlp_pipeline_create([stem(english), stopwords(['The'])], P),
+    nlp_analyze(P, "The Walking DEAD, 2", X).
+test(pipeline, [true(X==["cheval", "eton"])]) :-
+    nlp_pipeline_create([stem(french), unaccent(true), numbers(false),
+                         stopwords([les]), type(string)], P),
+    nlp_analyze(P, 'Les CHEVAUX étonnamment 42', X).
+test(pipeline, [true(X==[dead])]) :-
+    stopword_set_create([walking], S, [stem(english)]),
+    nlp_pipeline_create([stem(english), stopwords(S)], P),
+    nlp_analyze(P, "Walked dead", X).
+test(pipeline, [true(X==[chaud])]) :-
+    stopword_set_create(['Été'], S, [unaccent(true)]),
+    nlp_pipeline_create([unaccent(true), stopwords(S)], P),
+    nlp_analyze(P, "ÉTÉ chaud", X).
+test(pipeline, [error(domain_error(stopword_set, _))]) :-
+    stopword_set_create([walking], S, [stem(english)]),
+    nlp_pipeline_create([stem(dutch), stopwords(S)], _).
+test(pipeline, [error(domain_error(stopword_set, _))]) :-
+    stopword_set_create([walking], S, []),
+    nlp_pipeline_create([unaccent(true), stopwords(S)], _).
+test(snowball_pool, [true(Reused > 0)]) :-
+    snowball_pool_warm_up(dutch, 1),
+    thread_create(snowball(dutch, wandelen, _), Id, []),
+    thread_join(Id, true),
+    snowball_pool_property(reused(Reused)).
+
 :- if(exists_source('../sgml/iso_639')).
 :- use_module('../sgml/iso_639').
 
@@ -91,3 +241,86 @@ stem(Code, For, Stem) :-
 :- endif.
 
 :- end_tests(snowball).
+
+
+:- begin_tests(isub).
+
+test(isub, D == 0.7113475177304964) :-
+    isub('E56.Language', 'languange', D, [normalize(true),zero_to_one(true)]).
+test(engine, D1 == D2) :-
+    long_label(L1, L2),
+    isub(L1, L2, D1, [engine(scan)]),
+    isub(L1, L2, D2, [engine(automaton)]).
+test(max_work, W > 0) :-
+    long_label(L1, L2),
+    isub(L1, L2, D0, []),
+    isub(L1, L2, D, [work(W)]),
+    assertion(D == D0),
+    isub(L1, L2, D1, [max_work(10)]),
+    assertion(D1 =< D0).
+test(max_work, error(resource_error(isub_work))) :-
+    long_label(L1, L2),
+    isub(L1, L2, _, [max_work(10), on_exhausted(error)]).
+test(max_work, W > 0) :-
+    setup_call_cleanup(
+        open_string(":- use_module(library(isub)).
+                     isub_work_test(W) :-
+                         isub(aap, aapje, _, [max_work(1000), work(W)]).",
+                    In),
+        load_files(user:isub_work_test, [stream(In)]),
+        close(In)),
+    user:isub_work_test(W).
+test(tokens, D == 0.9090909090909091) :-
+    isub_tokens('Department of Health and Human Services',
+                'Health and Human Services Department',
+                D, [normalize(true)]).
+test(many, Ds == Expected) :-
+    Candidates = [languange, 'E56', "lang", [0'L], 'Straße', ''],
+    isub_prepare('E56.Language', [normalize(true)], Q),
+    isub_many(Q, Candidates, Ds),
+    maplist(isub_normalized('E56.Language'), Candidates, Expected).
+test(remove, Ds == [1.0, 1.0]) :-
+    isub_prepare('ΣΟΦΙΑ-Σοφία', [normalize(true), remove('-')], Q),
+    isub_many(Q, ['σοφιασοφία', "σοφια-σοφία"], Ds).
+test(best, Ranked == [D1-'E56', D2-lang]) :-
+    isub_prepare('E56.Language', [normalize(true)], Q),
+    isub_best(Q, [foo, languange, bar, lang, 'E56'], 2, Ranked),
+    isub_normalized('E56.Language', 'E56', D1),
+    isub_normalized('E56.Language', lang, D2).
+test(above, D == D0) :-
+    isub(joe, joey, D0, []),
+    isub_above(joe, joey, 0.5, D).
+test(above, fail) :-
+    isub_above(joe, hoe, 0.5, _).
+test(join, Pairs == Expected) :-
+    A = [languange, 'E56', "lang"],
+    B = ['E56.Language', 'Lang', foo],
+    isub_join(A, B, 0.0, [normalize(true), threads(2)], Pairs),
+    findall(D-(X-Y),
+            ( member(X, A), member(Y, B),
+              isub_normalized(X, Y, D), D >= 0.0 ),
+            Expected).
+test(index, Matches == [D2-lang, D1-languange]) :-
+    isub_index_create([foo, languange, bar, lang, 'E56'],
+                      [normalize(true)], Index),
+    isub_index_delete(Index, 'E56'),
+    isub_index_query(Index, 'E56.Language', 0.0, Matches),
+    isub_normalized('E56.Language', languange, D1),
+    isub_normalized('E56.Language', lang, D2).
+test(dict, Matches == Expected) :-
+    Labels = [foo, languange, 'Lang.', bar, lang, 'E56', ''],
+    isub_dict_create(Labels, [normalize(true)], Dict),
+    isub_dict_query(Dict, 'E56.Language', 0.0, Matches),
+    findall(D-L,
+            ( member(L, Labels),
+              isub_normalized('E56.Language', L, D), D >= 0.0 ),
+            Pairs),
+    sort(1, @>=, Pairs, Expected).
+
+isub_normalized(T1, T2, D) :-
+    isub(T1, T2, D, [normalize(true)]).
+
+long_label('Department of Health and Human Services, Office of the Secretary',
+           'Office of the Secretary of the Department of Health Services').
+
+:- end_tests(isub).
@@ -0,0 +1,248 @@
+/*  Part of SWI-Prolog
+
+    Author:        Jan Wielemaker
+    E-mail:        J.Wielemaker@vu.nl
+    WWW:           http://www.swi-prolog.org
+    Copyright (c)  2026, SWI-Prolog Solutions b.v.
+    All rights reserved.
+
+    Redistribution and use in source and binary forms, with or without
+    modification, are permitted provided that the following conditions
+    are met:
+
+    1. Redistributions of source code must retain the above copyright
+       notice, this list of conditions and the following disclaimer.
+
+    2. Redistributions in binary form must reproduce the above copyright
+       notice, this list of conditions and the following disclaimer in
+       the documentation and/or other materials provided with the
+       distribution.
+
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+    "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+    LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+    FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+    COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+    INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+    BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+    LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+    CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+    LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+    ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+    POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+Microbenchmark and golden test for tokenizeA()  from tokenize.ic.  It
+tokenizes a generated corpus of log-like ISO Latin-1 text using the
+current tokenizer and the original  version   based  on iswspace() and
+iswalnum(), checks that both produce the same tokens and reports MB/s
+for both.  Numbers longer than 8 characters are rejected by the token
+callback to exercise the word fallback.  Run as
+
+    gcc -O2 -Wall -o tokenize_bench tokenize_bench.c && ./tokenize_bench
+
+The original version is run in the C.UTF-8  locale, which is where the
+tokenizer's character table comes from.
+- - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <locale.h>
+#include <time.h>
+#include <wctype.h>
+#include <wchar.h>
+
+#define PL_exception(t) 0
+#define TRUE  1
+#define FALSE 0
+
+#include "tokenize.ic"
+
+static int
+tokenize_legacyA(const char *in, size_t len,
+	  int (*call)(const char *s,
+		      size_t len,
+		      toktype type,
+		      void *closure),
+	  void *closure)
+{ const unsigned char *s = (const unsigned char*)in;
+  const unsigned char *se = &s[len];
+  toktype type;
+
+  while(s<se)
+  { const unsigned char *st;		/* start token */
+
+    while(s<se && iswspace(*s))		/* skip blanks */
+      s++;
+    if ( s >= se )
+      break;
+
+    st = s;
+    type = TOK_UNKNOWN;
+
+    if ( *s == '-' && se-s > 1 && isdigit(s[1]) )
+    { s += 2;
+      type = TOK_INT;
+    } else if ( isdigit(*s) )
+    { s++;
+      type = TOK_INT;
+    }
+
+    if ( type == TOK_INT )
+    { while(s<se && isdigit(*s))
+	s++;
+      if ( s+2 <= se && *s == '.' && isdigit(s[1]) )
+      { s += 2;
+	type = TOK_FLOAT;
+	while(s<se && isdigit(*s))
+	  s++;
+      }
+      if ( s+2 <= se &&
+	   (*s == 'e' || *s == 'E') &&
+	   (isdigit(s[1]) || (s+3 <= se && issign(s[1]) && isdigit(s[2]))) )
+      { s += 2;
+	type = TOK_FLOAT;
+	while(s<se && isdigit(*s))
+	  s++;
+      }
+
+      if ( !(*call)((const char*)st, s-st, type, closure) )
+      { if ( PL_exception(0) )
+	  return FALSE;
+	while(s<se && iswalnum(*s))
+	  s++;
+	if ( !(*call)((const char*)st, s-st, TOK_WORD, closure) )
+	  return FALSE;
+      }
+    } else if ( iswalnum(*s) )
+    { while(s<se && iswalnum(*s))
+	s++;
+      if ( !(*call)((const char*)st, s-st, TOK_WORD, closure) )
+	return FALSE;
+    } else
+    { s++;
+      if ( !(*call)((const char*)st, 1, TOK_PUNCT, closure) )
+	return FALSE;
+    }
+  }
+
+  return TRUE;
+}
+
+
+typedef struct
+{ const char   *base;
+  size_t	count;
+  unsigned long hash;
+} result;
+
+static int
+add_token(const char *s, size_t len, toktype type, void *closure)
+{ result *r = closure;
+
+  if ( (type == TOK_INT || type == TOK_FLOAT) && len > 8 )
+    return FALSE;
+
+  r->count++;
+  r->hash = r->hash*31 + (unsigned long)(s - r->base);
+  r->hash = r->hash*31 + (unsigned long)len;
+  r->hash = r->hash*31 + (unsigned long)type;
+
+  return TRUE;
+}
+
+static const char *words[] =
+{ "error", "connection", "timeout", "user", "Request", "GET", "caf\351",
+  "na\357ve", "\374ber", "Stra\337e", "x86_64", "id", "0x1f", "v2",
+  "-", "--", "/", "[", "]", ":", "=", ",", ".", "\"", "\253", "\273",
+  NULL
+};
+
+static size_t
+make_corpus(char *buf, size_t size)
+{ size_t n = 0;
+  size_t nwords = 0;
+
+  while(words[nwords])
+    nwords++;
+
+  while ( n+64 < size )
+  { int r = rand()%16;
+    char tmp[64];
+    const char *t = tmp;
+
+    if ( r < 8 )
+      t = words[rand()%nwords];
+    else if ( r < 10 )
+      snprintf(tmp, sizeof(tmp), "%d", rand()%100000 - 1000);
+    else if ( r < 11 )
+      snprintf(tmp, sizeof(tmp), "%d.%de%d", rand()%100, rand()%1000,
+	       rand()%20 - 10);
+    else if ( r < 12 )
+      snprintf(tmp, sizeof(tmp), "%d%d%d", rand(), rand(), rand());
+    else if ( r < 13 )
+    { int i, l = rand()%20;
+
+      for(i=0; i<l; i++)
+	tmp[i] = (char)(rand()%255 + 1);
+      tmp[l] = 0;
+    } else
+      snprintf(tmp, sizeof(tmp), "%c", " \t\n\r\240\205\034"[rand()%7]);
+
+    n += strlen(strcpy(&buf[n], t));
+    if ( rand()%3 )
+      buf[n++] = ' ';
+  }
+
+  return n;
+}
+
+static double
+run(int (*tokenize)(const char*, size_t,
+		    int (*)(const char*, size_t, toktype, void*), void*),
+    const char *buf, size_t len, int times, result *r)
+{ clock_t t0 = clock();
+  int i;
+
+  for(i=0; i<times; i++)
+  { r->base = buf;
+    r->count = 0;
+    r->hash = 0;
+    (*tokenize)(buf, len, add_token, r);
+  }
+
+  return (double)len*times/(1024.0*1024.0) /
+	 ((double)(clock()-t0)/CLOCKS_PER_SEC);
+}
+
+int
+main(int argc, char **argv)
+{ size_t size = 16*1024*1024;
+  char *buf = malloc(size);
+  size_t len;
+  result r1, r2;
+  double mbs1, mbs2;
+
+  (void)tokenizeW;			/* only tokenizeA() is measured */
+  if ( !setlocale(LC_CTYPE, "C.UTF-8") &&
+       !setlocale(LC_CTYPE, "en_US.UTF-8") )
+    fprintf(stderr, "Warning: no UTF-8 locale\n");
+
+  srand(42);
+  len = make_corpus(buf, size);
+  mbs1 = run(tokenize_legacyA, buf, len, 3, &r1);
+  mbs2 = run(tokenizeA, buf, len, 3, &r2);
+
+  printf("%zu bytes, %zu tokens\n", len, r2.count);
+  printf("iswspace/iswalnum: %8.1f MB/s\n", mbs1);
+  printf("table:             %8.1f MB/s\n", mbs2);
+  if ( r1.count != r2.count || r1.hash != r2.hash )
+  { printf("MISMATCH: %zu tokens (hash %lx) vs %zu tokens (hash %lx)\n",
+	   r1.count, r1.hash, r2.count, r2.hash);
+    return 1;
+  }
+
+  return 0;
+}